@@ -0,0 +1,203 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <iomanip>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+
+#include "commands.h"
+#include "histogram.h"
+#include "shm_ring.h"
+#include "transport.h"
+
+// Round-trip benchmark against a running server: /ping latency one at a time, then
+// pipelined /ping throughput. Compares TCP loopback, the Unix socket and the
+// shared-memory rings on equal footing.
+
+const int PORT = 5000;
+const char* SERVER_IP = "127.0.0.1";
+const std::string PONG_LINE = "Server: pong";
+
+using Clock = std::chrono::steady_clock;
+
+static void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--unix PATH [--shm]] [--count N] [--window N]\n"
+              << "  --count N   pings per phase (default 20000)\n"
+              << "  --window N  pings in flight during the throughput phase (default 64)\n";
+}
+
+// Buffered line reader over ChatTransport
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd_(fd) {}
+
+    bool next_line(std::string& line) {
+        for (;;) {
+            size_t pos = buf_.find('\n', start_);
+            if (pos != std::string::npos) {
+                line.assign(buf_, start_, pos - start_);
+                start_ = pos + 1;
+                if (start_ == buf_.size()) {
+                    buf_.clear();
+                    start_ = 0;
+                }
+                return true;
+            }
+            char temp[65536];
+            ssize_t n = ChatTransport::recv_some(fd_, temp, sizeof(temp));
+            if (n > 0) {
+                buf_.append(temp, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                ChatTransport::wait_readable(fd_, -1);
+                continue;
+            }
+            return false;
+        }
+    }
+
+    // Skips unrelated lines (joins, chat) until the next pong
+    bool next_pong() {
+        std::string line;
+        while (next_line(line)) {
+            if (line == PONG_LINE) return true;
+        }
+        return false;
+    }
+
+private:
+    int fd_;
+    std::string buf_;
+    size_t start_ = 0;
+};
+
+static int connect_server(const std::string& unix_path) {
+    int sock = socket(unix_path.empty() ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+
+    int rc;
+    if (unix_path.empty()) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(PORT);
+        inet_pton(AF_INET, SERVER_IP, &addr.sin_addr);
+        rc = connect(sock, (sockaddr*)&addr, sizeof(addr));
+    } else {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, unix_path.c_str(), sizeof(addr.sun_path) - 1);
+        rc = connect(sock, (sockaddr*)&addr, sizeof(addr));
+    }
+    if (rc < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int main(int argc, char* argv[]) {
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::string unix_path;
+    bool use_shm = false;
+    long count = 20000;
+    long window = 64;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        try {
+            if (arg == "--shm") use_shm = true;
+            else if (arg == "--unix" && i + 1 < argc) unix_path = argv[++i];
+            else if (arg == "--count" && i + 1 < argc) count = std::stol(argv[++i]);
+            else if (arg == "--window" && i + 1 < argc) window = std::stol(argv[++i]);
+            else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << "\n";
+            return 1;
+        }
+    }
+    if ((use_shm && unix_path.empty()) || count <= 0 || window <= 0 || unix_path.size() >= sizeof(sockaddr_un::sun_path)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char* transport = use_shm ? "shm" : unix_path.empty() ? "tcp" : "unix";
+
+    int sock = connect_server(unix_path);
+    if (sock < 0) {
+        std::cerr << "Failed to connect to server: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::string handshake = "bench" + std::to_string(getpid());
+    if (use_shm) handshake += std::string(" ") + ChatShm::HANDSHAKE_EXTENSION;
+    if (!ChatCommands::send_safe(sock, handshake + "\n")) {
+        close(sock);
+        return 1;
+    }
+    if (use_shm) {
+        std::string reply, error;
+        auto stream = ChatShm::accept_offer(sock, reply, error);
+        if (!stream) {
+            std::cerr << (reply.empty() ? error + "\n" : reply);
+            close(sock);
+            return 1;
+        }
+        ChatTransport::attach(sock, std::move(stream));
+    }
+
+    LineReader reader(sock);
+    std::string line;
+    if (!reader.next_line(line)) { // welcome line
+        std::cerr << "Server closed the connection during the handshake.\n";
+        return 1;
+    }
+
+    // Phase 1: one ping in flight
+    ChatStats::Histogram rtt;
+    for (long i = 0; i < count; ++i) {
+        auto t0 = Clock::now();
+        if (!ChatCommands::send_safe(sock, "/ping\n") || !reader.next_pong()) {
+            std::cerr << "Connection lost during latency phase.\n";
+            return 1;
+        }
+        rtt.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count()));
+    }
+
+    // Phase 2: keep `window` pings in flight
+    long sent = 0, received = 0;
+    auto start = Clock::now();
+    while (sent < window && sent < count) {
+        if (!ChatCommands::send_safe(sock, "/ping\n")) return 1;
+        ++sent;
+    }
+    while (received < count) {
+        if (!reader.next_pong()) {
+            std::cerr << "Connection lost during throughput phase.\n";
+            return 1;
+        }
+        ++received;
+        if (sent < count) {
+            if (!ChatCommands::send_safe(sock, "/ping\n")) return 1;
+            ++sent;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << std::fixed << std::setprecision(0)
+              << transport << ": rtt " << rtt.summary() << "\n"
+              << transport << ": " << count / elapsed << " msgs/sec with " << window << " in flight\n";
+
+    shutdown(sock, SHUT_RDWR);
+    ChatTransport::detach(sock);
+    close(sock);
+    return 0;
+}
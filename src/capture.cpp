@@ -0,0 +1,170 @@
+#include "capture.h"
+#include "sync.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+namespace ChatCapture {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+    const char MAGIC[8] = {'C', 'H', 'A', 'T', 'C', 'A', 'P', '1'};
+    constexpr std::size_t WRITE_BUFFER_SIZE = 1 << 20;
+    constexpr std::uint64_t MAX_RECORD_PAYLOAD = 1 << 24; // sanity bound for the reader
+
+    struct Writer {
+        std::mutex m;
+        std::FILE* file = nullptr;
+        std::chrono::steady_clock::time_point start;
+        std::uint64_t bytes = 0;
+    };
+
+    Writer& writer() {
+        static Writer& w = ChatSync::leak<Writer>();
+        return w;
+    }
+
+    std::size_t put_varint(unsigned char* out, std::uint64_t v) {
+        std::size_t n = 0;
+        while (v >= 0x80) {
+            out[n++] = static_cast<unsigned char>(v | 0x80);
+            v >>= 7;
+        }
+        out[n++] = static_cast<unsigned char>(v);
+        return n;
+    }
+
+    void write_record(RecordType type, std::uint64_t conn_id, const char* data, std::size_t len, bool has_payload) {
+        Writer& w = writer();
+        std::lock_guard<std::mutex> lock(w.m);
+        if (!w.file) return;
+
+        auto t_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - w.start).count();
+
+        unsigned char header[1 + 3 * 10];
+        std::size_t n = 0;
+        header[n++] = static_cast<unsigned char>(type);
+        n += put_varint(header + n, conn_id);
+        n += put_varint(header + n, static_cast<std::uint64_t>(t_us));
+        if (has_payload) n += put_varint(header + n, len);
+
+        std::fwrite(header, 1, n, w.file);
+        if (has_payload && len) std::fwrite(data, 1, len, w.file);
+        w.bytes += n + (has_payload ? len : 0);
+    }
+}
+
+bool open(const std::string& path) {
+    Writer& w = writer();
+    std::lock_guard<std::mutex> lock(w.m);
+    if (w.file) return false;
+
+    w.file = std::fopen(path.c_str(), "wb");
+    if (!w.file) return false;
+    std::setvbuf(w.file, nullptr, _IOFBF, WRITE_BUFFER_SIZE);
+    std::fwrite(MAGIC, 1, sizeof(MAGIC), w.file);
+    w.bytes = sizeof(MAGIC);
+    w.start = std::chrono::steady_clock::now();
+    g_enabled = true;
+    return true;
+}
+
+void close() {
+    g_enabled = false;
+    Writer& w = writer();
+    std::lock_guard<std::mutex> lock(w.m);
+    if (w.file) {
+        std::fclose(w.file);
+        w.file = nullptr;
+    }
+}
+
+void flush() {
+    Writer& w = writer();
+    std::lock_guard<std::mutex> lock(w.m);
+    if (w.file) std::fflush(w.file);
+}
+
+void record_connect(std::uint64_t conn_id, const std::string& peer) {
+    write_record(RecordType::Connect, conn_id, peer.data(), peer.size(), true);
+}
+
+void record_data(std::uint64_t conn_id, const char* data, std::size_t len) {
+    write_record(RecordType::Data, conn_id, data, len, true);
+}
+
+void record_disconnect(std::uint64_t conn_id) {
+    write_record(RecordType::Disconnect, conn_id, nullptr, 0, false);
+}
+
+std::uint64_t bytes_written() {
+    Writer& w = writer();
+    std::lock_guard<std::mutex> lock(w.m);
+    return w.bytes;
+}
+
+// ---------- Reader ----------
+
+Reader::~Reader() {
+    if (file_) std::fclose(file_);
+}
+
+bool Reader::open(const std::string& path, std::string& error) {
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    char magic[sizeof(MAGIC)];
+    if (std::fread(magic, 1, sizeof(magic), file_) != sizeof(magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        error = path + " is not a chat capture file";
+        return false;
+    }
+    return true;
+}
+
+bool Reader::read_varint(std::uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = std::fgetc(file_);
+        if (c == EOF) return false;
+        v |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+bool Reader::next(Record& rec) {
+    int type = std::fgetc(file_);
+    if (type == EOF) return false; // clean end of capture
+
+    rec.type = static_cast<RecordType>(type);
+    rec.payload.clear();
+    if (type < static_cast<int>(RecordType::Connect) || type > static_cast<int>(RecordType::Disconnect)) {
+        error_ = "corrupt record type " + std::to_string(type);
+        return false;
+    }
+    if (!read_varint(rec.conn_id) || !read_varint(rec.t_us)) {
+        error_ = "truncated record header";
+        return false;
+    }
+    if (rec.type == RecordType::Disconnect) return true;
+
+    std::uint64_t len = 0;
+    if (!read_varint(len) || len > MAX_RECORD_PAYLOAD) {
+        error_ = "truncated or oversized record payload";
+        return false;
+    }
+    rec.payload.resize(static_cast<std::size_t>(len));
+    if (len && std::fread(&rec.payload[0], 1, rec.payload.size(), file_) != rec.payload.size()) {
+        error_ = "truncated record payload";
+        return false;
+    }
+    return true;
+}
+
+} // namespace ChatCapture
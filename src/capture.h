@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Binary capture of inbound server traffic, replayable with bin/replay.
+//
+// File layout:
+//   magic   "CHATCAP1" (8 bytes)
+//   records, back to back:
+//     u8      type     (Connect = 1, Data = 2, Disconnect = 3)
+//     varint  conn_id  (server-assigned, never reused within a capture)
+//     varint  t_us     (microseconds since the capture started)
+//     Connect/Data only:
+//     varint  length, then `length` bytes (peer address / raw bytes from recv)
+// Varints are unsigned LEB128.
+
+namespace ChatCapture {
+
+    enum class RecordType : std::uint8_t {
+        Connect    = 1,
+        Data       = 2,
+        Disconnect = 3
+    };
+
+    struct Record {
+        RecordType    type = RecordType::Data;
+        std::uint64_t conn_id = 0;
+        std::uint64_t t_us = 0;
+        std::string   payload; // peer address for Connect, raw bytes for Data
+    };
+
+    constexpr const char* UNIX_PEER = "unix"; // Connect payload for peers on the server's Unix socket
+
+    // ---- Writer (server side; one process-wide capture file) ----
+    extern std::atomic<bool> g_enabled;
+    inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+    bool open(const std::string& path);
+    void close();
+    void flush();
+
+    void record_connect(std::uint64_t conn_id, const std::string& peer);
+    void record_data(std::uint64_t conn_id, const char* data, std::size_t len);
+    void record_disconnect(std::uint64_t conn_id);
+
+    std::uint64_t bytes_written();
+
+    // ---- Reader (bin/replay) ----
+    class Reader {
+    public:
+        Reader() = default;
+        ~Reader();
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool open(const std::string& path, std::string& error);
+        // Returns false at end of file or on a truncated/corrupt record (see error())
+        bool next(Record& rec);
+        const std::string& error() const { return error_; }
+
+    private:
+        bool read_varint(std::uint64_t& v);
+
+        std::FILE*  file_ = nullptr;
+        std::string error_;
+    };
+
+} // namespace ChatCapture
@@ -5,6 +5,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <csignal>
 #include <cerrno>
 #include <cstring>
@@ -12,6 +13,9 @@
 #include <atomic>
 
 #include "commands.h"
+#include "compress.h"
+#include "shm_ring.h"
+#include "transport.h"
 
 const int PORT = 5000;
 const char* SERVER_IP = "127.0.0.1";
@@ -37,20 +41,62 @@ void sigint_handler(int) {
     }
 }
 
+static void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--unix PATH [--shm]] [--compress]\n"
+              << "  --unix PATH  connect over the server's Unix socket instead of TCP\n"
+              << "  --shm        with --unix, exchange messages through shared-memory rings\n"
+              << "  --compress   ask the server to send large messages LZ4-compressed\n";
+}
+
+// Moves displayable text out of `pending`, expanding any compressed frames.
+// An incomplete frame stays at the front of `pending`; returns false on a corrupt one.
+static bool decode_incoming(std::string& pending, std::string& text) {
+    std::size_t pos = 0;
+    while (pos < pending.size()) {
+        if (pending[pos] != ChatCompress::FRAME_MARKER) {
+            std::size_t next = pending.find(ChatCompress::FRAME_MARKER, pos);
+            if (next == std::string::npos) next = pending.size();
+            text.append(pending, pos, next - pos);
+            pos = next;
+            continue;
+        }
+        std::size_t used = 0;
+        auto result = ChatCompress::decode_frame(pending.data() + pos, pending.size() - pos, used, text);
+        if (result == ChatCompress::DecodeResult::NeedMore) break;
+        if (result == ChatCompress::DecodeResult::Corrupt) return false;
+        pos += used;
+    }
+    pending.erase(0, pos);
+    return true;
+}
+
 // Reveive loop to handle incoming messages
 void receive_loop(int sock) {
     char buffer[ChatCommands::MAX_MESSAGE_LENGTH + 1];
+    std::string pending, text;
     while (true) {
-        ssize_t bytes = recv(sock, buffer, sizeof(buffer) - 1, 0);
+        ssize_t bytes = ChatTransport::recv_some(sock, buffer, sizeof(buffer) - 1);
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            ChatTransport::wait_readable(sock, -1);
+            continue;
+        }
         if (bytes <= 0) {
             std::cout << "Server disconnected.\n";
             running = false;
             std::raise(SIGINT); // Trigger main thread to exit
             break;
         }
-        buffer[bytes] = '\0';
-        std::cout << "\r" << buffer;
-        if (buffer[bytes-1] != '\n') std::cout << '\n';
+        pending.append(buffer, static_cast<std::size_t>(bytes));
+        text.clear();
+        if (!decode_incoming(pending, text)) {
+            std::cout << "\rReceived a corrupt compressed frame. Disconnecting.\n";
+            running = false;
+            std::raise(SIGINT);
+            break;
+        }
+        if (text.empty()) continue; // rest of the frame is still in flight
+        std::cout << "\r" << text;
+        if (text.back() != '\n') std::cout << '\n';
         std::cout << "> " << std::flush;
     }
 }
@@ -69,7 +115,32 @@ ChatCommands::CommandResult handle_command(const std::string& input, int sock) {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    std::string unix_path;
+    bool use_shm = false;
+    bool use_compress = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--unix" && i + 1 < argc) {
+            unix_path = argv[++i];
+        } else if (arg == "--shm") {
+            use_shm = true;
+        } else if (arg == "--compress") {
+            use_compress = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (use_shm && unix_path.empty()) {
+        std::cerr << "--shm requires --unix PATH.\n";
+        return 1;
+    }
+    if (unix_path.size() >= sizeof(sockaddr_un::sun_path)) {
+        std::cerr << "Unix socket path is too long.\n";
+        return 1;
+    }
+
     std::signal(SIGPIPE, SIG_IGN); // Ignore broken pipe signals
 
     std::ios::sync_with_stdio(false);
@@ -94,7 +165,7 @@ int main() {
     }
 
     // Create socket and connect to server
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    int sock = socket(unix_path.empty() ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
     if (sock < 0) {
         std::cerr << "Failed to create socket: " << std::strerror(errno) << "\n";
         g_sock = -1; // Reset global socket
@@ -104,40 +175,69 @@ int main() {
     g_sock = sock; // Store global socket for signal handling
     std::signal(SIGINT, sigint_handler); // Handle Ctrl+C gracefully
 
+    if (unix_path.empty()) {
+        sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(PORT);
 
-    sockaddr_in server_addr{};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
+        int ip_ok = inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
+        if (ip_ok == 0) {
+            std::cerr << "Invalid server IP address format: " << SERVER_IP << "\n";
+            close(sock);
+            g_sock = -1; // Reset global socket
+            return 1;
+        } else if (ip_ok == -1) {
+            std::cerr << "inet_pton failed: " << std::strerror(errno) << "\n";
+            close(sock);
+            g_sock = -1; // Reset global socket
+            return 1;
+        }
 
-    int ip_ok = inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
-    if (ip_ok == 0) {
-        std::cerr << "Invalid server IP address format: " << SERVER_IP << "\n";
-        close(sock);
-        g_sock = -1; // Reset global socket
-        return 1;
-    } else if (ip_ok == -1) {
-        std::cerr << "inet_pton failed: " << std::strerror(errno) << "\n";
-        close(sock);
-        g_sock = -1; // Reset global socket
-        return 1;
-    }
+        std::cout << "Connecting to server at... " << SERVER_IP << ":" << PORT << "...\n" << std::flush;
+        if (connect(sock, (sockaddr*)&server_addr, sizeof(server_addr)) == -1) { 
+            std::cerr << "Failed to connect to server: " << std::strerror(errno) << "\n";
+            close(sock);
+            g_sock = -1; // Reset global socket
+            return 1;
+        }
+    } else {
+        sockaddr_un server_addr{};
+        server_addr.sun_family = AF_UNIX;
+        std::strncpy(server_addr.sun_path, unix_path.c_str(), sizeof(server_addr.sun_path) - 1);
 
-    std::cout << "Connecting to server at... " << SERVER_IP << ":" << PORT << "...\n" << std::flush;
-    if (connect(sock, (sockaddr*)&server_addr, sizeof(server_addr)) == -1) { 
-        std::cerr << "Failed to connect to server: " << std::strerror(errno) << "\n";
-        close(sock);
-        g_sock = -1; // Reset global socket
-        return 1;
+        std::cout << "Connecting to server at... " << unix_path << "...\n" << std::flush;
+        if (connect(sock, (sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
+            std::cerr << "Failed to connect to server: " << std::strerror(errno) << "\n";
+            close(sock);
+            g_sock = -1; // Reset global socket
+            return 1;
+        }
     }
 
-    // Send username first as server expects it
-    if (!ChatCommands::send_safe(sock, username + std::string("\n"))) {
+    // Send username first as server expects it, followed by any requested extensions
+    std::string handshake = username;
+    if (use_shm) handshake += std::string(" ") + ChatShm::HANDSHAKE_EXTENSION;
+    if (use_compress) handshake += std::string(" ") + ChatCompress::HANDSHAKE_EXTENSION;
+    if (!ChatCommands::send_safe(sock, handshake + "\n")) {
         std::cerr << "Failed to send username: " << std::strerror(errno) << "\n";
         close(sock);
         g_sock = -1; // Reset global socket
         return 1;
     }
 
+    if (use_shm) {
+        std::string reply, error;
+        auto stream = ChatShm::accept_offer(sock, reply, error);
+        if (!stream) {
+            if (!reply.empty()) std::cerr << reply;
+            else std::cerr << "Shared-memory setup failed: " << error << "\n";
+            close(sock);
+            g_sock = -1; // Reset global socket
+            return 1;
+        }
+        ChatTransport::attach(sock, std::move(stream));
+    }
+
     std::thread rx(receive_loop, sock);
 
     std::string input;
@@ -180,6 +280,8 @@ int main() {
 
     shutdown(sock, SHUT_RDWR);
     if (rx.joinable()) rx.join();
+    if (use_compress) std::cout << ChatCompress::report() << std::flush;
+    ChatTransport::detach(sock);
     close(sock);
     g_sock = -1; // Reset global socket
     return 0;
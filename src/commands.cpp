@@ -10,9 +10,10 @@
 #include <unordered_map>
 #include <vector>
 
-#include <sys/socket.h>
 #include <unistd.h>
 
+#include "transport.h"
+
 namespace ChatCommands {
 
 // ---------- Function definitions declared in commands.h ----------
@@ -24,19 +25,33 @@ bool is_valid_username(const std::string& s) {
     });
 }
 
+static SendHook send_hook = nullptr;
+
+void set_send_hook(SendHook hook) {
+    send_hook = hook;
+}
+
 // Robust "send all" that respects MAX_MESSAGE_LENGTH and retries on partial sends.
-bool send_safe(int sock, const std::string& msg) {
+// Non-blocking connections wait up to SEND_TIMEOUT_MS for buffer space before giving up.
+bool send_safe(int sock, const std::string& msg, Lane lane) {
     if (msg.size() > MAX_MESSAGE_LENGTH) {
         std::cerr << "Message too long.\n";
         return false;
     }
+    if (send_hook) return send_hook(sock, msg, lane);
     const char* buf = msg.data();
     size_t left = msg.size();
     while (left > 0) {
-        ssize_t n = ::send(sock, buf, left, 0);
+        ssize_t n = ChatTransport::send_some(sock, buf, left);
         if (n < 0) {
             if (errno == EINTR) continue;
-            if (errno == EAGAIN || errno == EWOULDBLOCK) { continue; } // could add small sleep/poll
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!ChatTransport::wait_writable(sock, SEND_TIMEOUT_MS)) {
+                    std::cerr << "send timed out\n";
+                    return false;
+                }
+                continue;
+            }
             perror("send failed");
             return false;
         }
@@ -46,17 +61,75 @@ bool send_safe(int sock, const std::string& msg) {
     return true;
 }
 
+// ---------- /who roster ----------
+
+namespace {
+    std::uint64_t current_roster_version = 1; // guarded by the server mutex (see commands.h)
+
+    constexpr std::size_t WHO_HEADER_RESERVE = 64; // room for the "(page i/n, N total)" header
+}
+
+void roster_changed() {
+    ++current_roster_version;
+}
+
+std::uint64_t roster_version() {
+    return current_roster_version;
+}
+
+// Serializes the roster into messages that each fit in MAX_MESSAGE_LENGTH
+std::vector<std::string> build_who_pages(const std::unordered_map<int, std::string>& client_names) {
+    std::vector<std::string> names;
+    names.reserve(client_names.size());
+    for (const auto& [fd, name] : client_names) {
+        (void)fd;
+        names.push_back(name);
+    }
+    std::sort(names.begin(), names.end()); // stable order so pages don't shuffle between calls
+
+    std::size_t body_size = 0;
+    for (const auto& name : names) body_size += name.size() + 3;
+
+    const std::string single_header = "Connected users:\n";
+    if (single_header.size() + body_size <= MAX_MESSAGE_LENGTH) {
+        std::string list;
+        list.reserve(single_header.size() + body_size);
+        list += single_header;
+        for (const auto& name : names) {
+            list.append("  ").append(name).append("\n");
+        }
+        return {list};
+    }
+
+    std::vector<std::string> bodies(1);
+    for (const auto& name : names) {
+        if (bodies.back().size() + name.size() + 3 > MAX_MESSAGE_LENGTH - WHO_HEADER_RESERVE) {
+            bodies.emplace_back();
+        }
+        bodies.back().append("  ").append(name).append("\n");
+    }
+
+    std::vector<std::string> pages;
+    pages.reserve(bodies.size());
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+        pages.push_back("Connected users (page " + std::to_string(i + 1) + "/" + std::to_string(bodies.size())
+                        + ", " + std::to_string(names.size()) + " total):\n" + bodies[i]);
+    }
+    return pages;
+}
+
 // ---------- Extern objects from commands.h ----------
 
-const std::string help_text =
+// Leaked (see ChatSync::leak): detached client threads may still dispatch commands at exit
+const std::string& help_text = ChatSync::leak<const std::string>(
     "Available commands:\n"
     "  /quit                 - Exit chat\n"
     "  /help                 - Show this help message\n"
-    "  /who                  - List connected users\n"
+    "  /who [page]           - List connected users\n"
     "  /whisper <user> <msg> - Private message\n"
     "  /name <new_username>  - Change your username\n"
     "  /clear                - Clear the terminal\n"
-    "  /ping                 - Check connection with server\n";
+    "  /ping                 - Check connection with server\n");
 
 std::chrono::steady_clock::time_point last_ping_time =
     std::chrono::steady_clock::now() - std::chrono::seconds(PING_COOLDOWN_SECONDS);
@@ -68,7 +141,8 @@ static inline void ltrim_inplace(std::string& s) {
     else s.clear();
 }
 
-std::unordered_map<std::string, UnifiedCommand> unified_command_table = {
+std::unordered_map<std::string, UnifiedCommand>& unified_command_table =
+    ChatSync::leak<std::unordered_map<std::string, UnifiedCommand>>(std::unordered_map<std::string, UnifiedCommand>{
     {
         "/quit",
         {
@@ -90,8 +164,8 @@ std::unordered_map<std::string, UnifiedCommand> unified_command_table = {
                 return CommandResult::Continue;
             },
             // Server
-            [](int client_fd, const std::string&, std::unordered_map<int, std::string>&, std::vector<int>&, std::mutex&) {
-                send_safe(client_fd, help_text);
+            [](int client_fd, const std::string&, std::unordered_map<int, std::string>&, std::vector<int>&, ChatSync::Mutex&) {
+                send_safe(client_fd, help_text, Lane::Control);
             }
         }
     },
@@ -99,19 +173,13 @@ std::unordered_map<std::string, UnifiedCommand> unified_command_table = {
         "/who",
         {
             // Client
-            [](std::istringstream&, int sock) {
-                return send_safe(sock, "/who\n") ? CommandResult::Continue : CommandResult::Invalid;
+            [](std::istringstream& iss, int sock) {
+                std::string page; iss >> page;
+                std::string request = page.empty() ? "/who\n" : "/who " + page + "\n";
+                return send_safe(sock, request) ? CommandResult::Continue : CommandResult::Invalid;
             },
-            // Server
-            [](int client_fd, const std::string&, std::unordered_map<int, std::string>& client_names, std::vector<int>&, std::mutex& m) {
-                std::lock_guard<std::mutex> lock(m);
-                std::string list = "Connected users:\n";
-                for (const auto& [fd, name] : client_names) {
-                    (void)fd;
-                    list += "  " + name + "\n";
-                }
-                send_safe(client_fd, list);
-            }
+            // Server: registered by server.cpp, which caches the pages as outbound payloads
+            nullptr
         }
     },
     {
@@ -132,21 +200,21 @@ std::unordered_map<std::string, UnifiedCommand> unified_command_table = {
                 return send_safe(sock, full) ? CommandResult::Continue : CommandResult::Invalid;
             },
             // Server
-            [](int client_fd, const std::string& raw, std::unordered_map<int, std::string>& client_names, std::vector<int>&, std::mutex& m) {
+            [](int client_fd, const std::string& raw, std::unordered_map<int, std::string>& client_names, std::vector<int>&, ChatSync::Mutex& m) {
                 std::istringstream iss(raw);
                 std::string cmd, target; iss >> cmd >> target;
                 std::string msg; std::getline(iss, msg);
                 ltrim_inplace(msg);
 
-                std::lock_guard<std::mutex> lock(m);
+                ChatSync::LockGuard lock(m);
                 auto it = std::find_if(client_names.begin(), client_names.end(),
                     [&](const auto& p) { return p.second == target; });
 
                 if (it != client_names.end()) {
                     std::string reply = "(whisper from " + client_names[client_fd] + "): " + msg + "\n";
-                    send_safe(it->first, reply);
+                    send_safe(it->first, reply, Lane::Direct);
                 } else {
-                    send_safe(client_fd, "User not found.\n");
+                    send_safe(client_fd, "User not found.\n", Lane::Control);
                 }
             }
         }
@@ -164,26 +232,27 @@ std::unordered_map<std::string, UnifiedCommand> unified_command_table = {
                     return CommandResult::Invalid;
                 }
 
-                return send_safe(sock, std::string("/name ") + new_name) + "\n"
+                return send_safe(sock, "/name " + new_name + "\n")
                        ? CommandResult::Continue : CommandResult::Invalid;
             },
             // Server
-            [](int client_fd, const std::string& raw, std::unordered_map<int, std::string>& client_names, std::vector<int>&, std::mutex& m) {
+            [](int client_fd, const std::string& raw, std::unordered_map<int, std::string>& client_names, std::vector<int>&, ChatSync::Mutex& m) {
                 std::istringstream iss(raw);
                 std::string cmd, new_name; iss >> cmd >> new_name;
 
                 if (!is_valid_username(new_name)) {
-                    send_safe(client_fd, "Invalid username.\n");
+                    send_safe(client_fd, "Invalid username.\n", Lane::Control);
                     return;
                 }
 
-                std::lock_guard<std::mutex> lock(m);
+                ChatSync::LockGuard lock(m);
                 std::string old_name = client_names[client_fd];
                 client_names[client_fd] = new_name;
+                roster_changed();
 
                 std::string notice = old_name + " changed name to " + new_name + "\n";
                 for (const auto& [fd, _] : client_names) {
-                    if (fd != client_fd) send_safe(fd, notice);
+                    if (fd != client_fd) send_safe(fd, notice, Lane::Broadcast);
                 }
             }
         }
@@ -219,11 +288,11 @@ std::unordered_map<std::string, UnifiedCommand> unified_command_table = {
                 return send_safe(sock, "/ping\n") ? CommandResult::Continue : CommandResult::Invalid;
             },
             // Server
-            [](int client_fd, const std::string&, std::unordered_map<int, std::string>&, std::vector<int>&, std::mutex&) {
-                send_safe(client_fd, "Server: pong\n");
+            [](int client_fd, const std::string&, std::unordered_map<int, std::string>&, std::vector<int>&, ChatSync::Mutex&) {
+                send_safe(client_fd, "Server: pong\n", Lane::Control);
             }
         }
     },
-};
+});
 
 } // namespace ChatCommands
@@ -7,6 +7,9 @@
 #include <vector>
 #include <mutex>
 #include <chrono>
+#include <cstdint>
+
+#include "sync.h"
 
 namespace ChatCommands {
 
@@ -14,6 +17,7 @@ namespace ChatCommands {
     constexpr std::size_t MAX_MESSAGE_LENGTH   = 1024;
     constexpr std::size_t MAX_USERNAME_LENGTH  = 32;
     constexpr int         PING_COOLDOWN_SECONDS = 5;
+    constexpr int         SEND_TIMEOUT_MS       = 5000; // max wait for a full socket to drain
 
     // Result of client-side command processing
     enum class CommandResult {
@@ -22,6 +26,14 @@ namespace ChatCommands {
         Invalid
     };
 
+    // Outbound priority class. The server flushes Control (pong, errors, help) ahead of
+    // Direct (replies and whispers) ahead of Broadcast (chat, joins, renames).
+    enum class Lane {
+        Control,
+        Direct,
+        Broadcast
+    };
+
     using ClientCommandHandler = std::function<CommandResult(std::istringstream&, int)>;
 
     using ServerCommandHandler = std::function<void(
@@ -29,7 +41,7 @@ namespace ChatCommands {
         const std::string& raw,
         std::unordered_map<int, std::string>& client_names,
         std::vector<int>& clients,
-        std::mutex& m
+        ChatSync::Mutex& m
     )>;
 
     struct UnifiedCommand {
@@ -39,10 +51,22 @@ namespace ChatCommands {
 
     // ---- Declarations (definitions live in commands.cpp) ----
     bool is_valid_username(const std::string& name);
-    bool send_safe(int sock, const std::string& msg);
+    bool send_safe(int sock, const std::string& msg, Lane lane = Lane::Direct);
+
+    // When set, send_safe hands messages to the hook (the server's outbound queues)
+    // instead of writing them inline. Clients leave it unset.
+    using SendHook = bool (*)(int sock, const std::string& msg, Lane lane);
+    void set_send_hook(SendHook hook);
+
+    // /who roster, guarded by the server mutex passed to the handlers.
+    // Call roster_changed() with that mutex held after every client_names change; the
+    // server caches build_who_pages() output until roster_version() moves.
+    void roster_changed();
+    std::uint64_t roster_version();
+    std::vector<std::string> build_who_pages(const std::unordered_map<int, std::string>& client_names);
 
-    extern const std::string help_text;
+    extern const std::string& help_text;
     extern std::chrono::steady_clock::time_point last_ping_time;
-    extern std::unordered_map<std::string, UnifiedCommand> unified_command_table;
+    extern std::unordered_map<std::string, UnifiedCommand>& unified_command_table;
 
 } // namespace ChatCommands
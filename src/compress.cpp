@@ -0,0 +1,269 @@
+#include "compress.h"
+
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <time.h>
+
+namespace ChatCompress {
+
+namespace {
+    // LZ4 block format constraints (see lz4_Block_format.md in the LZ4 sources)
+    constexpr std::size_t MIN_MATCH     = 4;
+    constexpr std::size_t LAST_LITERALS = 5;     // a block always ends with at least 5 literals
+    constexpr std::size_t MF_LIMIT      = 12;    // and no match starts in its last 12 bytes
+    constexpr std::size_t MAX_OFFSET    = 65535;
+    constexpr int         HASH_BITS     = 12;
+
+    struct DirectionStats {
+        std::atomic<std::uint64_t> frames{0};
+        std::atomic<std::uint64_t> skipped{0};   // encode only: sent as plain text instead
+        std::atomic<std::uint64_t> raw_bytes{0}; // text bytes carried by frames
+        std::atomic<std::uint64_t> wire_bytes{0};
+        std::atomic<std::uint64_t> work_bytes{0}; // every byte the codec touched, framed or not
+        std::atomic<std::uint64_t> cpu_ns{0};
+    };
+
+    DirectionStats encode_stats;
+    DirectionStats decode_stats;
+
+    // CPU time of the calling thread, so a preempted encode isn't billed for the wait
+    std::uint64_t thread_cpu_ns() {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+    }
+
+    std::uint32_t read32(const unsigned char* p) {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    std::uint32_t hash4(std::uint32_t v) {
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Length continuation bytes that follow a saturated (15) token nibble
+    unsigned char* put_length(unsigned char* op, std::size_t len) {
+        while (len >= 255) {
+            *op++ = 255;
+            len -= 255;
+        }
+        *op++ = static_cast<unsigned char>(len);
+        return op;
+    }
+
+    bool read_length(const unsigned char*& ip, const unsigned char* end, std::size_t& len) {
+        for (;;) {
+            if (ip == end) return false;
+            unsigned char b = *ip++;
+            len += b;
+            if (b != 255) return true;
+        }
+    }
+
+    // One sequence: literals, then a match of match_len bytes at `offset` (0/0 for the last one)
+    unsigned char* put_sequence(unsigned char* op, const unsigned char* literals, std::size_t lit_len,
+                                std::size_t offset, std::size_t match_len) {
+        unsigned char* token = op++;
+        *token = static_cast<unsigned char>((lit_len >= 15 ? 15 : lit_len) << 4);
+        if (lit_len >= 15) op = put_length(op, lit_len - 15);
+        std::memcpy(op, literals, lit_len);
+        op += lit_len;
+        if (match_len == 0) return op;
+
+        *op++ = static_cast<unsigned char>(offset & 0xff);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+        std::size_t ml = match_len - MIN_MATCH;
+        *token |= static_cast<unsigned char>(ml >= 15 ? 15 : ml);
+        if (ml >= 15) op = put_length(op, ml - 15);
+        return op;
+    }
+
+    void put_varint(std::string& out, std::uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<char>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<char>(v));
+    }
+
+    DecodeResult get_varint(const char* data, std::size_t len, std::size_t& pos, std::uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos == len) return DecodeResult::NeedMore;
+            auto c = static_cast<unsigned char>(data[pos++]);
+            v |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+            if (!(c & 0x80)) return DecodeResult::Ok;
+        }
+        return DecodeResult::Corrupt;
+    }
+
+    void report_direction(std::ostringstream& oss, const char* name, const DirectionStats& s, bool show_skipped) {
+        std::uint64_t frames = s.frames.load(), raw = s.raw_bytes.load(), wire = s.wire_bytes.load();
+        std::uint64_t work = s.work_bytes.load();
+        oss << "  " << name << " " << frames << " frames, " << raw << " -> " << wire << " bytes";
+        if (wire) oss << " (" << static_cast<double>(raw) / static_cast<double>(wire) << ":1)";
+        oss << ", " << (work ? static_cast<double>(s.cpu_ns.load()) / static_cast<double>(work) : 0.0) << " CPU ns/byte";
+        if (show_skipped) oss << ", " << s.skipped.load() << " sent as text";
+        oss << "\n";
+    }
+}
+
+std::size_t max_compressed_size(std::size_t len) {
+    return len + len / 255 + 16;
+}
+
+std::size_t compress_block(const char* src, std::size_t len, char* dst) {
+    const auto* in = reinterpret_cast<const unsigned char*>(src);
+    auto* op = reinterpret_cast<unsigned char*>(dst);
+    std::size_t anchor = 0;
+
+    if (len > MF_LIMIT) {
+        std::uint32_t table[1 << HASH_BITS] = {}; // position + 1 of the last 4-byte sequence per hash
+        const std::size_t match_limit = len - LAST_LITERALS;
+        std::size_t ip = 0;
+        while (ip < len - MF_LIMIT) {
+            std::uint32_t seq = read32(in + ip);
+            std::uint32_t& slot = table[hash4(seq)];
+            std::size_t ref = slot;
+            slot = static_cast<std::uint32_t>(ip + 1);
+            if (ref == 0 || ip - (ref - 1) > MAX_OFFSET || read32(in + ref - 1) != seq) {
+                ++ip;
+                continue;
+            }
+            --ref;
+
+            // Grow the match backwards over pending literals, then forwards
+            while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+                --ip;
+                --ref;
+            }
+            std::size_t end = ip + MIN_MATCH;
+            while (end < match_limit && in[end] == in[ref + (end - ip)]) ++end;
+
+            op = put_sequence(op, in + anchor, ip - anchor, ip - ref, end - ip);
+            ip = anchor = end;
+        }
+    }
+
+    op = put_sequence(op, in + anchor, len - anchor, 0, 0);
+    return static_cast<std::size_t>(op - reinterpret_cast<unsigned char*>(dst));
+}
+
+bool decompress_block(const char* src, std::size_t len, char* dst, std::size_t out_len) {
+    const auto* ip = reinterpret_cast<const unsigned char*>(src);
+    const auto* end = ip + len;
+    auto* out = reinterpret_cast<unsigned char*>(dst);
+    auto* op = out;
+    auto* out_end = out + out_len;
+
+    while (ip < end) {
+        unsigned token = *ip++;
+
+        std::size_t lit_len = token >> 4;
+        if (lit_len == 15 && !read_length(ip, end, lit_len)) return false;
+        if (lit_len > static_cast<std::size_t>(end - ip) || lit_len > static_cast<std::size_t>(out_end - op)) return false;
+        std::memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip == end) break; // the last sequence carries no match
+
+        if (end - ip < 2) return false;
+        std::size_t offset = ip[0] | (static_cast<std::size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<std::size_t>(op - out)) return false;
+
+        std::size_t match_len = token & 15;
+        if (match_len == 15 && !read_length(ip, end, match_len)) return false;
+        match_len += MIN_MATCH;
+        if (match_len > static_cast<std::size_t>(out_end - op)) return false;
+
+        const unsigned char* match = op - offset;
+        if (offset >= match_len) {
+            std::memcpy(op, match, match_len);
+        } else {
+            for (std::size_t i = 0; i < match_len; ++i) op[i] = match[i]; // overlapping run
+        }
+        op += match_len;
+    }
+    return op == out_end;
+}
+
+std::string encode_frame(const std::string& text) {
+    if (text.size() < MIN_COMPRESS_BYTES) return {};
+
+    std::uint64_t start = thread_cpu_ns();
+    thread_local std::vector<char> scratch;
+    scratch.resize(max_compressed_size(text.size()));
+    std::size_t data_len = compress_block(text.data(), text.size(), scratch.data());
+
+    std::string frame;
+    frame.reserve(1 + 2 * 10 + data_len);
+    frame.push_back(FRAME_MARKER);
+    put_varint(frame, text.size());
+    put_varint(frame, data_len);
+    if (frame.size() + data_len >= text.size()) {
+        frame.clear(); // incompressible: plain text is cheaper
+    } else {
+        frame.append(scratch.data(), data_len);
+    }
+
+    encode_stats.cpu_ns.fetch_add(thread_cpu_ns() - start, std::memory_order_relaxed);
+    encode_stats.work_bytes.fetch_add(text.size(), std::memory_order_relaxed);
+    if (frame.empty()) {
+        encode_stats.skipped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        encode_stats.frames.fetch_add(1, std::memory_order_relaxed);
+        encode_stats.raw_bytes.fetch_add(text.size(), std::memory_order_relaxed);
+        encode_stats.wire_bytes.fetch_add(frame.size(), std::memory_order_relaxed);
+    }
+    return frame;
+}
+
+DecodeResult decode_frame(const char* data, std::size_t len, std::size_t& consumed, std::string& text) {
+    if (len == 0) return DecodeResult::NeedMore;
+    if (data[0] != FRAME_MARKER) return DecodeResult::Corrupt;
+
+    std::size_t pos = 1;
+    std::uint64_t raw_len = 0, data_len = 0;
+    DecodeResult r = get_varint(data, len, pos, raw_len);
+    if (r == DecodeResult::Ok) r = get_varint(data, len, pos, data_len);
+    if (r != DecodeResult::Ok) return r;
+    if (raw_len > MAX_FRAME_BYTES || data_len > max_compressed_size(MAX_FRAME_BYTES)) return DecodeResult::Corrupt;
+    if (len - pos < data_len) return DecodeResult::NeedMore;
+
+    std::uint64_t start = thread_cpu_ns();
+    std::size_t old_size = text.size();
+    text.resize(old_size + raw_len);
+    if (!decompress_block(data + pos, data_len, &text[old_size], raw_len)) {
+        text.resize(old_size);
+        return DecodeResult::Corrupt;
+    }
+    consumed = pos + data_len;
+
+    decode_stats.cpu_ns.fetch_add(thread_cpu_ns() - start, std::memory_order_relaxed);
+    decode_stats.work_bytes.fetch_add(raw_len, std::memory_order_relaxed);
+    decode_stats.frames.fetch_add(1, std::memory_order_relaxed);
+    decode_stats.raw_bytes.fetch_add(raw_len, std::memory_order_relaxed);
+    decode_stats.wire_bytes.fetch_add(consumed, std::memory_order_relaxed);
+    return DecodeResult::Ok;
+}
+
+std::string report() {
+    bool encoded = encode_stats.work_bytes.load() > 0;
+    bool decoded = decode_stats.frames.load() > 0;
+    if (!encoded && !decoded) return {};
+
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2) << "compression (lz4):\n";
+    if (encoded) report_direction(oss, "encoded", encode_stats, true);
+    if (decoded) report_direction(oss, "decoded", decode_stats, false);
+    return oss.str();
+}
+
+} // namespace ChatCompress
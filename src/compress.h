@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Optional server -> client compression, negotiated in the username handshake.
+//
+// A client that appends HANDSHAKE_EXTENSION to its username line accepts compressed
+// frames mixed in with plain text:
+//   u8      0x00     (FRAME_MARKER; never appears in chat text)
+//   varint  raw_len  (bytes once decompressed; always whole lines)
+//   varint  data_len
+//   data_len bytes of one LZ4 block
+// Varints are unsigned LEB128. A server that parses "+extension" tokens but doesn't
+// support this one ignores it and keeps sending plain text, which the client still
+// reads as before. Servers older than the extension handshake refuse the whole line
+// as an invalid username.
+//
+// The codec is a self-contained implementation of the LZ4 block format, so no
+// external library is needed.
+
+namespace ChatCompress {
+
+    constexpr const char* HANDSHAKE_EXTENSION = "+lz4";
+    constexpr char        FRAME_MARKER        = '\0';
+    constexpr std::size_t MIN_COMPRESS_BYTES  = 128;     // smaller messages are never worth a frame
+    constexpr std::size_t MAX_FRAME_BYTES     = 1 << 20; // decoder limit on raw_len
+
+    // Raw LZ4 block codec
+    std::size_t max_compressed_size(std::size_t len);
+    std::size_t compress_block(const char* src, std::size_t len, char* dst); // dst holds max_compressed_size(len)
+    // Returns false unless src decodes to exactly out_len bytes within its bounds
+    bool decompress_block(const char* src, std::size_t len, char* dst, std::size_t out_len);
+
+    // Server side: returns the framed form of text, or an empty string when the
+    // message is too small or the frame would not be smaller than the text.
+    std::string encode_frame(const std::string& text);
+
+    enum class DecodeResult { Ok, NeedMore, Corrupt };
+
+    // Client side: decodes one frame starting at data[0] (the marker). On Ok, `consumed`
+    // is the frame's size and the decompressed text is appended to `text`.
+    DecodeResult decode_frame(const char* data, std::size_t len, std::size_t& consumed, std::string& text);
+
+    // Compression ratio and CPU cost per byte, for whichever direction was used
+    std::string report();
+
+} // namespace ChatCompress
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace ChatStats {
+
+    // Log-linear (HDR-style) histogram of nanosecond values.
+    // 16 sub-buckets per power of two keeps every bucket within ~6% of its value.
+    // Buckets are relaxed atomics so one writer and any number of readers can share it.
+    class Histogram {
+    public:
+        static constexpr int SUB_BITS  = 4;
+        static constexpr int SUB_COUNT = 1 << SUB_BITS;
+        static constexpr int BUCKETS   = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+        void record(std::uint64_t v) {
+            buckets_[index_of(v)].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(v, std::memory_order_relaxed);
+            std::uint64_t prev = max_.load(std::memory_order_relaxed);
+            while (v > prev && !max_.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {}
+        }
+
+        void merge(const Histogram& other) {
+            for (int i = 0; i < BUCKETS; ++i) {
+                std::uint64_t n = other.buckets_[i].load(std::memory_order_relaxed);
+                if (n) buckets_[i].fetch_add(n, std::memory_order_relaxed);
+            }
+            count_.fetch_add(other.count(), std::memory_order_relaxed);
+            sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::uint64_t v = other.max();
+            std::uint64_t prev = max_.load(std::memory_order_relaxed);
+            while (v > prev && !max_.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {}
+        }
+
+        std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+        std::uint64_t max() const   { return max_.load(std::memory_order_relaxed); }
+        std::uint64_t mean() const  { auto n = count(); return n ? sum_.load(std::memory_order_relaxed) / n : 0; }
+
+        // Upper bound of the bucket holding the p-th percentile (p in [0, 100])
+        std::uint64_t percentile(double p) const {
+            std::uint64_t n = count();
+            if (n == 0) return 0;
+            std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(n) + 0.5);
+            if (rank == 0) rank = 1;
+            std::uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; ++i) {
+                seen += buckets_[i].load(std::memory_order_relaxed);
+                if (seen >= rank) {
+                    std::uint64_t hi = upper_bound_of(i);
+                    return hi < max() ? hi : max();
+                }
+            }
+            return max();
+        }
+
+        // One-line summary, e.g. "n=120 p50=1.2us p90=3.0us p99=8.1us max=12.4us"
+        std::string summary() const {
+            std::ostringstream oss;
+            oss << "n=" << count()
+                << " mean=" << format_ns(mean())
+                << " p50=" << format_ns(percentile(50))
+                << " p90=" << format_ns(percentile(90))
+                << " p99=" << format_ns(percentile(99))
+                << " max=" << format_ns(max());
+            return oss.str();
+        }
+
+        static std::string format_ns(std::uint64_t ns) {
+            std::ostringstream oss;
+            oss.setf(std::ios::fixed);
+            oss.precision(1);
+            if (ns < 1000) oss << ns << "ns";
+            else if (ns < 1000000) oss << ns / 1e3 << "us";
+            else if (ns < 1000000000) oss << ns / 1e6 << "ms";
+            else oss << ns / 1e9 << "s";
+            return oss.str();
+        }
+
+    private:
+        static int index_of(std::uint64_t v) {
+            if (v < static_cast<std::uint64_t>(SUB_COUNT)) return static_cast<int>(v);
+            int e = 63 - __builtin_clzll(v);
+            int sub = static_cast<int>((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+            return (e - SUB_BITS + 1) * SUB_COUNT + sub;
+        }
+
+        static std::uint64_t upper_bound_of(int idx) {
+            if (idx < SUB_COUNT) return static_cast<std::uint64_t>(idx);
+            int e = idx / SUB_COUNT + SUB_BITS - 1;
+            std::uint64_t sub = static_cast<std::uint64_t>(idx % SUB_COUNT);
+            std::uint64_t lower = (SUB_COUNT + sub) << (e - SUB_BITS);
+            return lower + ((std::uint64_t{1} << (e - SUB_BITS)) - 1);
+        }
+
+        std::array<std::atomic<std::uint64_t>, BUCKETS> buckets_{};
+        std::atomic<std::uint64_t> count_{0};
+        std::atomic<std::uint64_t> sum_{0};
+        std::atomic<std::uint64_t> max_{0};
+    };
+
+    // Monotonic timestamp in nanoseconds, the unit every Histogram records
+    inline std::uint64_t now_ns() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // One row of a stats table: two-space indent, label padded to a column, then the summary
+    inline std::string report_row(const std::string& label, const Histogram& h) {
+        constexpr std::size_t LABEL_WIDTH = 10;
+        std::string row = "  " + label;
+        row.append(label.size() < LABEL_WIDTH ? LABEL_WIDTH - label.size() : 1, ' ');
+        return row + h.summary();
+    }
+
+} // namespace ChatStats
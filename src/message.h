@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+// One outgoing server message, shared by every connection it is queued on.
+// Recipients that negotiated compression (see compress.h) share a single compressed
+// frame, built the first time one of them needs it. wire() lives in outbound.cpp.
+
+namespace ChatOutbound {
+
+    class Message {
+    public:
+        explicit Message(std::string text) : text_(std::move(text)) {}
+
+        const std::string& text() const { return text_; }
+        const std::string& wire(bool compress) const; // the frame, or text() if it doesn't pay
+
+    private:
+        std::string text_;
+        mutable std::once_flag frame_once_;
+        mutable std::string frame_; // empty when compression would not shrink the text
+    };
+
+    using Payload = std::shared_ptr<const Message>;
+    inline Payload make_payload(std::string text) { return std::make_shared<const Message>(std::move(text)); }
+
+} // namespace ChatOutbound
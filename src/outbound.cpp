@@ -0,0 +1,310 @@
+#include "outbound.h"
+#include "compress.h"
+#include "histogram.h"
+#include "sync.h"
+#include "transport.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+namespace ChatOutbound {
+
+namespace {
+    constexpr int LANES = 3;
+    constexpr int LANE_WEIGHTS[LANES] = {8, 4, 1}; // Control, Direct, Broadcast
+    const char* const lane_names[LANES] = {"control", "direct", "broadcast"};
+    constexpr int STREAM_RETRY_MS = 1; // attached streams have no POLLOUT; retry on a timer
+
+    using ChatStats::now_ns;
+
+    struct Pending {
+        Payload msg;
+        const std::string* bytes = nullptr; // msg's text or compressed frame
+        std::uint64_t enqueued_ns = 0;
+    };
+
+    enum class FlushResult { Idle, Blocked, Dead };
+
+    struct Connection {
+        std::mutex m;
+        std::deque<Pending> lanes[LANES];
+        std::size_t queued_bytes = 0;
+        int credits[LANES] = {LANE_WEIGHTS[0], LANE_WEIGHTS[1], LANE_WEIGHTS[2]};
+
+        // Message currently on the wire; it must finish before another lane may go
+        Pending current;
+        int current_lane = -1;
+        std::size_t offset = 0;
+
+        bool blocked = false; // handed to the flusher until the socket drains
+        bool dead = false;
+        std::atomic<bool> compress{false}; // read without m so the frame is built outside it
+    };
+
+    struct LaneStats {
+        ChatStats::Histogram latency; // enqueue -> last byte written
+        std::atomic<std::uint64_t> rejected{0};
+    };
+
+    ChatSync::Mutex& out_m = ChatSync::leak<ChatSync::Mutex>("out_m");
+    auto& connections = ChatSync::leak<std::unordered_map<int, std::shared_ptr<Connection>>>(); // guarded by out_m
+    auto& blocked_fds = ChatSync::leak<std::unordered_set<int>>();                              // guarded by out_m
+
+    LaneStats lane_stats[LANES];
+    std::atomic<std::uint64_t> compressed_sends{0};
+    std::atomic<bool> running{false};
+    std::thread flusher;
+    int wake_fd = -1;
+
+    std::shared_ptr<Connection> find(int fd) {
+        ChatSync::LockGuard lock(out_m);
+        auto it = connections.find(fd);
+        return it != connections.end() ? it->second : nullptr;
+    }
+
+    // Picks the next lane by weighted round-robin; -1 when every lane is empty
+    int pick_lane(Connection& c) {
+        for (int pass = 0; pass < 2; ++pass) {
+            bool any = false;
+            for (int lane = 0; lane < LANES; ++lane) {
+                if (c.lanes[lane].empty()) continue;
+                any = true;
+                if (c.credits[lane] > 0) return lane;
+            }
+            if (!any) return -1;
+            for (int lane = 0; lane < LANES; ++lane) c.credits[lane] = LANE_WEIGHTS[lane]; // new round
+        }
+        return -1;
+    }
+
+    // Writes as much as the connection takes right now. Call with c.m held.
+    FlushResult flush_locked(int fd, Connection& c) {
+        for (;;) {
+            if (c.current_lane < 0) {
+                int lane = pick_lane(c);
+                if (lane < 0) return FlushResult::Idle;
+                c.current = std::move(c.lanes[lane].front());
+                c.lanes[lane].pop_front();
+                --c.credits[lane];
+                c.current_lane = lane;
+                c.offset = 0;
+            }
+
+            const std::string& data = *c.current.bytes;
+            ssize_t n = ChatTransport::send_some(fd, data.data() + c.offset, data.size() - c.offset);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return FlushResult::Blocked;
+                return FlushResult::Dead;
+            }
+            c.offset += static_cast<std::size_t>(n);
+            if (c.offset < data.size()) continue;
+
+            lane_stats[c.current_lane].latency.record(now_ns() - c.current.enqueued_ns);
+            c.queued_bytes -= data.size();
+            c.current = Pending{};
+            c.current_lane = -1;
+        }
+    }
+
+    void mark_dead_locked(int fd, Connection& c) {
+        c.dead = true;
+        for (auto& lane : c.lanes) lane.clear();
+        c.current = Pending{};
+        c.current_lane = -1;
+        c.queued_bytes = 0;
+        shutdown(fd, SHUT_RDWR); // wake the reader thread so it runs the normal cleanup
+    }
+
+    void wake_flusher() {
+        if (wake_fd >= 0) eventfd_write(wake_fd, 1);
+    }
+
+    void flusher_loop() {
+        std::vector<int> fds;
+        std::vector<pollfd> pfds;
+        while (running) {
+            fds.clear();
+            {
+                ChatSync::LockGuard lock(out_m);
+                fds.assign(blocked_fds.begin(), blocked_fds.end());
+            }
+
+            pfds.clear();
+            pfds.push_back({wake_fd, POLLIN, 0});
+            bool has_streams = false;
+            for (int fd : fds) {
+                if (ChatTransport::find(fd)) has_streams = true;
+                else pfds.push_back({fd, POLLOUT, 0});
+            }
+
+            int ready = poll(pfds.data(), pfds.size(), has_streams ? STREAM_RETRY_MS : 100);
+            if (ready < 0 && errno != EINTR) break;
+            if (pfds[0].revents & POLLIN) {
+                eventfd_t ignored;
+                eventfd_read(wake_fd, &ignored);
+            }
+
+            // Retrying a socket that is not writable yet just returns EAGAIN, so try them all
+            for (int fd : fds) {
+                auto conn = find(fd);
+                if (!conn) {
+                    ChatSync::LockGuard lock(out_m);
+                    blocked_fds.erase(fd);
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(conn->m);
+                if (conn->dead) continue;
+                FlushResult result = flush_locked(fd, *conn);
+                if (result == FlushResult::Blocked) continue;
+                if (result == FlushResult::Dead) mark_dead_locked(fd, *conn);
+                conn->blocked = false;
+                ChatSync::LockGuard out_lock(out_m);
+                blocked_fds.erase(fd);
+            }
+        }
+    }
+}
+
+const std::string& Message::wire(bool compress) const {
+    if (!compress) return text_;
+    std::call_once(frame_once_, [this] { frame_ = ChatCompress::encode_frame(text_); });
+    return frame_.empty() ? text_ : frame_;
+}
+
+void start() {
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    running = true;
+    flusher = std::thread(flusher_loop);
+}
+
+void stop(int drain_timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(drain_timeout_ms);
+    for (;;) {
+        bool pending;
+        {
+            ChatSync::LockGuard lock(out_m);
+            pending = !blocked_fds.empty();
+        }
+        if (!pending || std::chrono::steady_clock::now() >= deadline) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    running = false;
+    wake_flusher();
+    if (flusher.joinable()) flusher.join();
+    ::close(wake_fd);
+    wake_fd = -1;
+}
+
+void open(int fd) {
+    ChatSync::LockGuard lock(out_m);
+    connections[fd] = std::make_shared<Connection>();
+}
+
+void close(int fd) {
+    std::shared_ptr<Connection> conn;
+    {
+        ChatSync::LockGuard lock(out_m);
+        auto it = connections.find(fd);
+        if (it == connections.end()) return;
+        conn = std::move(it->second);
+        connections.erase(it);
+        blocked_fds.erase(fd);
+    }
+    // Waits out any flush in progress, so nothing is written once the fd can be reused
+    std::lock_guard<std::mutex> lock(conn->m);
+    conn->dead = true;
+}
+
+void enable_compression(int fd) {
+    if (auto conn = find(fd)) conn->compress = true;
+}
+
+bool enqueue(int fd, ChatCommands::Lane lane, Payload payload) {
+    int idx = static_cast<int>(lane);
+    auto conn = find(fd);
+    if (!conn) {
+        ++lane_stats[idx].rejected;
+        return false;
+    }
+    if (payload->text().empty()) return true;
+
+    const std::string& bytes = payload->wire(conn->compress);
+    std::lock_guard<std::mutex> lock(conn->m);
+    if (conn->dead || conn->queued_bytes + bytes.size() > MAX_QUEUED_BYTES) {
+        ++lane_stats[idx].rejected;
+        return false;
+    }
+    if (&bytes != &payload->text()) ++compressed_sends;
+    conn->queued_bytes += bytes.size();
+    conn->lanes[idx].push_back(Pending{std::move(payload), &bytes, now_ns()});
+
+    if (conn->blocked) return true; // the flusher owns it until the socket drains
+
+    FlushResult result = flush_locked(fd, *conn);
+    if (result == FlushResult::Dead) {
+        mark_dead_locked(fd, *conn);
+        return false;
+    }
+    if (result == FlushResult::Blocked) {
+        conn->blocked = true;
+        {
+            ChatSync::LockGuard out_lock(out_m);
+            blocked_fds.insert(fd);
+        }
+        wake_flusher();
+    }
+    return true;
+}
+
+bool send_hook(int fd, const std::string& msg, ChatCommands::Lane lane) {
+    return enqueue(fd, lane, make_payload(msg));
+}
+
+std::string report() {
+    std::vector<std::shared_ptr<Connection>> snapshot;
+    std::size_t blocked = 0;
+    {
+        ChatSync::LockGuard lock(out_m);
+        blocked = blocked_fds.size();
+        snapshot.reserve(connections.size());
+        for (const auto& [fd, conn] : connections) {
+            (void)fd;
+            snapshot.push_back(conn);
+        }
+    }
+
+    // Connection locks are taken before out_m elsewhere, so never nest them the other way
+    std::size_t backlog[LANES] = {};
+    for (const auto& conn : snapshot) {
+        std::lock_guard<std::mutex> conn_lock(conn->m);
+        for (int lane = 0; lane < LANES; ++lane) backlog[lane] += conn->lanes[lane].size();
+    }
+
+    std::ostringstream oss;
+    oss << "outbound lanes (" << blocked << " connections waiting for the socket, "
+        << compressed_sends.load() << " compressed sends):\n";
+    for (int lane = 0; lane < LANES; ++lane) {
+        oss << ChatStats::report_row(lane_names[lane], lane_stats[lane].latency)
+            << " queued=" << backlog[lane]
+            << " rejected=" << lane_stats[lane].rejected.load() << "\n";
+    }
+    return oss.str();
+}
+
+} // namespace ChatOutbound
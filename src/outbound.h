@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+#include "commands.h"
+#include "message.h"
+
+// Per-connection outbound queues for the server.
+//
+// Every message is queued on one of three lanes (ChatCommands::Lane). Whenever the
+// connection can take more bytes, a weighted round-robin picks the next message:
+// each round grants Control 8, Direct 4 and Broadcast 1 messages, always serving the
+// highest-priority lane that has both data and credit. A control reply therefore
+// waits behind at most the message already on the wire plus one round's worth of
+// lower-lane credit, no matter how much broadcast backlog has piled up.
+//
+// Writes happen inline on the enqueuing thread while the socket keeps up; once it
+// reports EAGAIN the connection is handed to a flusher thread that resumes when the
+// socket becomes writable again.
+//
+// Connections that negotiated compression (see compress.h) are sent each Message's
+// compressed frame instead of its text, so a broadcast is compressed once however many
+// recipients share it.
+
+namespace ChatOutbound {
+
+    constexpr std::size_t MAX_QUEUED_BYTES = 4 << 20; // per connection, across all lanes
+
+    void start();                     // spawn the flusher thread
+    void stop(int drain_timeout_ms);  // give queues a chance to drain, then stop the flusher
+
+    void open(int fd);   // before the first send on a new connection
+    void close(int fd);  // before close(fd); anything still queued is discarded
+    void enable_compression(int fd); // after the handshake, before the first send
+
+    // Queues payload on fd's lane. Returns false if fd is unknown, dead, or over
+    // MAX_QUEUED_BYTES (the caller treats that like a failed send).
+    bool enqueue(int fd, ChatCommands::Lane lane, Payload payload);
+
+    // ChatCommands::SendHook adapter so command handlers go through the lanes too
+    bool send_hook(int fd, const std::string& msg, ChatCommands::Lane lane);
+
+    std::string report(); // per-lane queueing latency and backlog
+
+} // namespace ChatOutbound
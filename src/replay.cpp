@@ -0,0 +1,338 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <thread>
+#include <iomanip>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+
+#include "capture.h"
+#include "shm_ring.h"
+
+// Replays a server capture (see capture.h) against a live server, preserving
+// per-connection byte streams and, unless --fast is given, the original timing.
+// Connections captured on the server's Unix socket are replayed over --unix PATH when
+// given, TCP otherwise. Shared-memory rings are set up out of band, so "+shm" is
+// dropped from replayed handshakes and that traffic goes over the socket instead.
+
+const int DEFAULT_PORT = 5000;
+const char* DEFAULT_SERVER_IP = "127.0.0.1";
+const int DRAIN_GRACE_MS = 500; // keep reading replies this long after the last record
+
+using Clock = std::chrono::steady_clock;
+
+struct ReplayStats {
+    unsigned long long records = 0;
+    unsigned long long connects = 0;
+    unsigned long long failed_connects = 0;
+    unsigned long long lines_sent = 0;
+    unsigned long long bytes_sent = 0;
+    unsigned long long bytes_received = 0;
+    unsigned long long send_errors = 0;
+    unsigned long long closed_by_server = 0;
+    unsigned long long unix_connects = 0;
+    unsigned long long shm_downgrades = 0;
+};
+
+struct Target {
+    sockaddr_in tcp{};
+    std::string unix_path; // empty: replay Unix socket peers over TCP too
+};
+
+struct Conn {
+    int fd = -1;
+    bool handshake_sent = false;
+    std::string handshake; // first-line bytes held back until the line is complete
+};
+
+static ReplayStats stats;
+static std::unordered_map<std::uint64_t, Conn> conns; // capture conn_id -> live connection
+static volatile std::sig_atomic_t interrupted = false;
+
+static void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " CAPTURE_FILE [--host IP] [--port N] [--unix PATH] [--speed X | --fast]\n"
+              << "  --unix PATH  replay connections captured on the Unix socket over PATH\n"
+              << "  --speed X  replay at X times the captured pace (default 1)\n"
+              << "  --fast     ignore captured timing and send as fast as possible\n";
+}
+
+// Reads and discards whatever the server has sent back, so its send buffers never fill up.
+// Connections the server has closed are dropped; later records for them are skipped.
+static void drain_replies(int timeout_ms) {
+    std::vector<pollfd> pfds;
+    std::vector<std::uint64_t> ids;
+    pfds.reserve(conns.size());
+    ids.reserve(conns.size());
+    for (const auto& [id, conn] : conns) {
+        pfds.push_back({conn.fd, POLLIN, 0});
+        ids.push_back(id);
+    }
+
+    timespec ts{timeout_ms / 1000, static_cast<long>(timeout_ms % 1000) * 1000000L};
+    if (ppoll(pfds.data(), pfds.size(), timeout_ms < 0 ? nullptr : &ts, nullptr) <= 0) return;
+
+    char buf[65536];
+    for (std::size_t i = 0; i < pfds.size(); ++i) {
+        if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        for (;;) {
+            ssize_t n = recv(pfds[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n > 0) {
+                stats.bytes_received += static_cast<unsigned long long>(n);
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+            // EOF or hard error: stop polling it, or every ppoll() returns immediately
+            ++stats.closed_by_server;
+            close(pfds[i].fd);
+            conns.erase(ids[i]);
+            break;
+        }
+    }
+}
+
+// Waits until `deadline`, servicing replies in the meantime
+static void wait_until(Clock::time_point deadline) {
+    for (;;) {
+        auto now = Clock::now();
+        if (now >= deadline || interrupted) return;
+        auto left_us = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+        if (conns.empty()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(left_us));
+            return;
+        }
+        int ms = static_cast<int>((left_us + 999) / 1000);
+        drain_replies(ms);
+    }
+}
+
+static int open_connection(const Target& target, bool unix_peer) {
+    bool use_unix = unix_peer && !target.unix_path.empty();
+    int fd = socket(use_unix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int rc;
+    if (use_unix) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, target.unix_path.c_str(), sizeof(addr.sun_path) - 1);
+        rc = connect(fd, (const sockaddr*)&addr, sizeof(addr));
+    } else {
+        rc = connect(fd, (const sockaddr*)&target.tcp, sizeof(target.tcp));
+    }
+    if (rc < 0) {
+        close(fd);
+        return -1;
+    }
+    if (use_unix) ++stats.unix_connects;
+    return fd;
+}
+
+// Drops " +shm" tokens from a handshake line (see the note at the top of this file)
+static std::string strip_shm(std::string line) {
+    const std::string token = std::string(" ") + ChatShm::HANDSHAKE_EXTENSION;
+    std::size_t pos = 0;
+    while ((pos = line.find(token, pos)) != std::string::npos) {
+        std::size_t end = pos + token.size();
+        if (end == line.size() || line[end] == ' ' || line[end] == '\r') {
+            line.erase(pos, token.size());
+            ++stats.shm_downgrades;
+        } else {
+            pos = end;
+        }
+    }
+    return line;
+}
+
+// Returns false if the bytes could not all be sent
+static bool send_all(std::uint64_t conn_id, const std::string& data) {
+    const char* buf = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        auto it = conns.find(conn_id);
+        if (it == conns.end()) return false; // the server closed it while we waited
+        ssize_t n = send(it->second.fd, buf, left, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            buf += n;
+            left -= static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            drain_replies(10); // server is slow to read; keep its replies flowing meanwhile
+            continue;
+        }
+        ++stats.send_errors;
+        return false;
+    }
+    return true;
+}
+
+static void apply(const ChatCapture::Record& rec, const Target& target) {
+    switch (rec.type) {
+        case ChatCapture::RecordType::Connect: {
+            ++stats.connects;
+            int fd = open_connection(target, rec.payload == ChatCapture::UNIX_PEER);
+            if (fd < 0) {
+                ++stats.failed_connects;
+                return;
+            }
+            conns[rec.conn_id].fd = fd;
+            break;
+        }
+        case ChatCapture::RecordType::Data: {
+            auto it = conns.find(rec.conn_id);
+            if (it == conns.end()) return; // its connect failed or the server closed it
+            Conn& conn = it->second;
+
+            std::string data;
+            if (conn.handshake_sent) {
+                data = rec.payload;
+            } else {
+                conn.handshake += rec.payload;
+                std::size_t nl = conn.handshake.find('\n');
+                if (nl == std::string::npos) return; // username line still incomplete
+                data = strip_shm(conn.handshake.substr(0, nl)) + conn.handshake.substr(nl);
+                conn.handshake.clear();
+                conn.handshake_sent = true;
+            }
+
+            if (!send_all(rec.conn_id, data)) return;
+            stats.bytes_sent += data.size();
+            for (char c : data) {
+                if (c == '\n') ++stats.lines_sent;
+            }
+            break;
+        }
+        case ChatCapture::RecordType::Disconnect: {
+            auto it = conns.find(rec.conn_id);
+            if (it == conns.end()) return;
+            close(it->second.fd);
+            conns.erase(it);
+            break;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, [](int) { interrupted = true; });
+
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string path = argv[1];
+    std::string host = DEFAULT_SERVER_IP;
+    int port = DEFAULT_PORT;
+    Target target;
+    double speed = 1.0; // 0 = as fast as possible
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--fast") {
+            speed = 0;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+        try {
+            if (arg == "--host") host = argv[++i];
+            else if (arg == "--unix") target.unix_path = argv[++i];
+            else if (arg == "--port") port = std::stoi(argv[++i]);
+            else if (arg == "--speed") speed = std::stod(argv[++i]);
+            else {
+                std::cerr << "Unknown option: " << arg << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i] << "\n";
+            return 1;
+        }
+        if ((arg == "--speed" && speed <= 0) || (arg == "--port" && (port <= 0 || port > 65535))) {
+            std::cerr << arg << " out of range.\n";
+            return 1;
+        }
+    }
+
+    if (target.unix_path.size() >= sizeof(sockaddr_un::sun_path)) {
+        std::cerr << "--unix path is too long.\n";
+        return 1;
+    }
+    target.tcp.sin_family = AF_INET;
+    target.tcp.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, host.c_str(), &target.tcp.sin_addr) != 1) {
+        std::cerr << "Invalid server IP address format: " << host << "\n";
+        return 1;
+    }
+
+    ChatCapture::Reader reader;
+    std::string error;
+    if (!reader.open(path, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    std::cout << "Replaying " << path << " against " << host << ":" << port;
+    if (!target.unix_path.empty()) std::cout << " and " << target.unix_path;
+    std::cout << " at ";
+    if (speed > 0) std::cout << speed << "x speed...\n" << std::flush;
+    else std::cout << "full speed...\n" << std::flush;
+
+    auto start = Clock::now();
+    // t_us counts from when the server opened the capture; replay from the first record
+    std::uint64_t first_t_us = 0, last_t_us = 0;
+    bool have_first = false;
+    ChatCapture::Record rec;
+    while (!interrupted && reader.next(rec)) {
+        ++stats.records;
+        if (!have_first) {
+            first_t_us = rec.t_us;
+            have_first = true;
+        }
+        last_t_us = rec.t_us;
+        if (speed > 0) {
+            auto offset = std::chrono::microseconds(static_cast<long long>(static_cast<double>(rec.t_us - first_t_us) / speed));
+            wait_until(start + offset);
+        }
+        apply(rec, target);
+    }
+    if (!reader.error().empty()) {
+        std::cerr << "Stopped early: " << reader.error() << "\n";
+    }
+
+    auto replay_end = Clock::now();
+    wait_until(replay_end + std::chrono::milliseconds(DRAIN_GRACE_MS));
+    for (const auto& [id, conn] : conns) {
+        (void)id;
+        close(conn.fd);
+    }
+
+    double elapsed = std::chrono::duration<double>(replay_end - start).count();
+    std::cout << std::fixed << std::setprecision(3)
+              << "records:          " << stats.records << "\n"
+              << "connects:         " << stats.connects << " (" << stats.failed_connects << " failed, "
+              << stats.unix_connects << " over the Unix socket)\n"
+              << "+shm downgraded:  " << stats.shm_downgrades << "\n"
+              << "lines sent:       " << stats.lines_sent << "\n"
+              << "bytes sent:       " << stats.bytes_sent << " (" << stats.send_errors << " send errors)\n"
+              << "bytes received:   " << stats.bytes_received << "\n"
+              << "closed by server: " << stats.closed_by_server << "\n"
+              << "captured span:    " << (last_t_us - first_t_us) / 1e6 << "s\n"
+              << "replay time:      " << elapsed << "s\n"
+              << "lines/sec:        " << (elapsed > 0 ? stats.lines_sent / elapsed : 0.0) << "\n";
+    return 0;
+}
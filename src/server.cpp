@@ -14,40 +14,105 @@
 #include <sstream>
 #include <cerrno>
 #include <cctype>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <poll.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
+#include "capture.h"
 #include "commands.h"
+#include "compress.h"
+#include "outbound.h"
+#include "shm_ring.h"
+#include "sync.h"
+#include "trace.h"
+#include "transport.h"
 
 namespace { 
-    std::mutex send_m;
-    std::unordered_map<int, int> send_failures; // fd -> number of consecutive send failures
+    ChatSync::Mutex& send_m = ChatSync::leak<ChatSync::Mutex>("send_m");
+    auto& send_failures = ChatSync::leak<std::unordered_map<int, int>>(); // fd -> number of consecutive send failures
     inline bool should_drop_fd(int fd, int threshold = 3) {
-        std::lock_guard<std::mutex> lock(send_m);
+        ChatSync::LockGuard lock(send_m);
         auto it = send_failures.find(fd);
         return it != send_failures.end() && it->second >= threshold;
         
     }
 
     inline void clear_fd_failures(int fd) {
-        std::lock_guard<std::mutex> lock(send_m);
+        ChatSync::LockGuard lock(send_m);
         send_failures.erase(fd);
     }
 }
 
 const int PORT = 5000;
 
-std::vector<int> clients;
-std::mutex m;
-std::unordered_map<int, std::string> client_names;
+// Tunables for the accept path (overridable on the command line)
+struct ServerConfig {
+    int backlog         = SOMAXCONN; // listen() backlog; the kernel clamps to net.core.somaxconn
+    int max_clients     = 1024;      // global cap on open connections (including mid-handshake)
+    int max_per_ip      = 64;        // cap on open connections from a single peer address
+    int accept_batch    = 64;        // max accept4() calls per wakeup before re-polling
+    int sndbuf          = 64 * 1024; // per-client SO_SNDBUF (0 = kernel default); keeps backlog in the lanes
+
+    bool trace          = false;     // per-message stage latency tracing (needs `make TRACE=1`)
+    int trace_sample    = 0;         // write one in N traced messages to trace_dump (0 = off)
+    std::string trace_dump;          // Chrome trace-event JSON written at shutdown
+
+    std::string capture;             // record inbound traffic here for bin/replay
+
+    std::string unix_path;           // also listen on this AF_UNIX socket (enables +shm clients)
+};
+
+ServerConfig config;
+
+std::vector<int>& clients = ChatSync::leak<std::vector<int>>();
+ChatSync::Mutex& m = ChatSync::leak<ChatSync::Mutex>("m");
+auto& client_names = ChatSync::leak<std::unordered_map<int, std::string>>();
+
+// /who pages, rebuilt when ChatCommands::roster_version() moves; guarded by m
+auto& who_pages = ChatSync::leak<std::shared_ptr<const std::vector<ChatOutbound::Payload>>>();
+std::uint64_t who_pages_version = 0;
+
+// Connection accounting for the accept path
+std::atomic<int> active_conns{0};
+std::atomic<std::uint64_t> next_conn_id{1}; // stable id per accepted socket, used by traffic capture
+ChatSync::Mutex& conn_m = ChatSync::leak<ChatSync::Mutex>("conn_m");
+auto& conns_per_ip = ChatSync::leak<std::unordered_map<std::string, int>>(); // peer ip -> open connections
+
+struct AcceptStats {
+    std::atomic<unsigned long long> accepted{0};
+    std::atomic<unsigned long long> rejected_global{0};
+    std::atomic<unsigned long long> rejected_per_ip{0};
+    std::atomic<unsigned long long> accept_errors{0};
+    std::atomic<unsigned long long> batches{0};
+    std::atomic<unsigned long long> max_batch{0};
+};
+
+AcceptStats accept_stats;
+const auto server_start = std::chrono::steady_clock::now();
+
+// Peer key used for AF_UNIX connections; local peers are exempt from the per-ip cap
+const std::string UNIX_PEER = ChatCapture::UNIX_PEER;
+
+const char* const SERVER_FULL_MSG   = "Server is full. Try again later.\n";
+const char* const TOO_MANY_FROM_MSG = "Too many connections from your address. Try again later.\n";
 
 volatile std::sig_atomic_t stop_server = false;
 volatile std::sig_atomic_t last_signal = 0;
+volatile std::sig_atomic_t dump_stats_requested = false;
 
 void signal_handler(int signal) {
     last_signal = signal;
     if (signal == SIGINT || signal == SIGTERM) {
         stop_server = true;
     }
+    if (signal == SIGUSR1) {
+        dump_stats_requested = true;
+    }
 }
 
 void print_signal_message(int signal) {
@@ -82,22 +147,26 @@ static std::string get_time() {
 }
 
 inline void record_send_failure(int fd) {
-    std::lock_guard<std::mutex> lock(send_m);
+    ChatSync::LockGuard lock(send_m);
     ++send_failures[fd];
 }
 
-static bool recv_into_buffer(int fd, std::string& buf) {
+static bool recv_into_buffer(int fd, std::string& buf, std::uint64_t conn_id) {
     for (;;) {
         char temp[4096];
-        ssize_t n = recv(fd, temp, sizeof(temp), 0);
+        ssize_t n = ChatTransport::recv_some(fd, temp, sizeof(temp));
         if (n > 0) {
+            TRACE_NOTE_RECV();
+            if (ChatCapture::enabled()) ChatCapture::record_data(conn_id, temp, static_cast<size_t>(n));
             buf.append(temp, static_cast<size_t>(n));
             return true;
         }
         if (n == 0) return false;                    // clean close
         if (errno == EINTR) continue;                // interrupted by signal → retry
-        if (errno == EAGAIN || errno == EWOULDBLOCK) // shouldn't happen on blocking sockets
+        if (errno == EAGAIN || errno == EWOULDBLOCK) { // non-blocking socket → wait for data
+            ChatTransport::wait_readable(fd, -1);
             continue;
+        }
         return false;                                // real error
     }
 }
@@ -116,16 +185,20 @@ static bool pop_line(std::string& buf, std::string& line) {
 void broadcast(const std::string& message, int sender_fd) {
     std::vector<int> snapshot; 
     {
-        std::lock_guard<std::mutex> lock(m);
+        ChatSync::LockGuard lock(m);
         snapshot = clients; // Take a snapshot of the current clients
     }
+    TRACE_STAGE(Snapshot);
+
+    // One shared copy (and at most one compressed frame) for every recipient's broadcast lane
+    auto payload = ChatOutbound::make_payload(message);
 
     std::vector<int> to_remove;
     for (int client_fd : snapshot) {
         if (client_fd == sender_fd) {
             continue; // Skip sending to the sender or clients that should be dropped
         }
-        if (ChatCommands::send_safe(client_fd, message)) {
+        if (ChatOutbound::enqueue(client_fd, ChatCommands::Lane::Broadcast, payload)) {
             clear_fd_failures(client_fd);
          } else {
             record_send_failure(client_fd); // Record the failure
@@ -135,16 +208,18 @@ void broadcast(const std::string& message, int sender_fd) {
             }
         }
     }
+    TRACE_STAGE(Enqueue);
 
     if (!to_remove.empty()) {
         std::vector<int> to_shutdown;
         {
-            std::lock_guard<std::mutex> lock(m);
+            ChatSync::LockGuard lock(m);
             for (int fd : to_remove) {
                 clients.erase(std::remove(clients.begin(), clients.end(), fd), clients.end());
                 client_names.erase(fd); // Remove from client names
                 to_shutdown.push_back(fd); // Collect fds to shutdown
             }
+            ChatCommands::roster_changed();
         }
 
         for (int fd : to_shutdown) {
@@ -155,7 +230,90 @@ void broadcast(const std::string& message, int sender_fd) {
     }
 }
 
-void handle_client(int client_fd) {
+// Releases a connection's share of the global and per-ip caps when it goes away
+struct ConnectionSlot {
+    std::string peer_ip;
+    std::uint64_t conn_id;
+    ~ConnectionSlot() {
+        if (ChatCapture::enabled()) ChatCapture::record_disconnect(conn_id);
+        {
+            ChatSync::LockGuard lock(conn_m);
+            auto it = conns_per_ip.find(peer_ip);
+            if (it != conns_per_ip.end() && --it->second <= 0) {
+                conns_per_ip.erase(it);
+            }
+        }
+        --active_conns;
+    }
+};
+
+// Detach any negotiated transport before the fd number can be reused
+static void close_client(int client_fd) {
+    ChatOutbound::close(client_fd);
+    ChatTransport::detach(client_fd);
+    close(client_fd);
+}
+
+// Splits the first line into the username and the "+extension" tokens after it, each
+// preceded by exactly one space. Returns false if anything else follows the username.
+static bool parse_handshake(const std::string& line, std::string& name, std::vector<std::string>& extensions) {
+    std::size_t end = line.find(' ');
+    name = line.substr(0, end);
+    while (end != std::string::npos) {
+        std::size_t start = end + 1;
+        end = line.find(' ', start);
+        std::string token = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (token.size() < 2 || token[0] != '+') return false;
+        extensions.push_back(std::move(token)); // unknown extensions are ignored
+    }
+    return true;
+}
+
+// /who: every requester shares the cached pages (and their compressed frames) until the roster changes
+static void handle_who(int client_fd, const std::string& raw, std::unordered_map<int, std::string>& names,
+                       std::vector<int>&, ChatSync::Mutex& names_m) {
+    std::istringstream iss(raw);
+    std::string cmd, page_arg; iss >> cmd >> page_arg;
+
+    std::shared_ptr<const std::vector<ChatOutbound::Payload>> pages;
+    {
+        ChatSync::LockGuard lock(names_m);
+        if (!who_pages || who_pages_version != ChatCommands::roster_version()) {
+            std::vector<ChatOutbound::Payload> built;
+            for (auto& page : ChatCommands::build_who_pages(names)) {
+                built.push_back(ChatOutbound::make_payload(std::move(page)));
+            }
+            who_pages = std::make_shared<const std::vector<ChatOutbound::Payload>>(std::move(built));
+            who_pages_version = ChatCommands::roster_version();
+        }
+        pages = who_pages;
+    }
+
+    // Send outside the lock; the shared pages stay valid even if the roster moves on
+    if (page_arg.empty()) {
+        for (const auto& page : *pages) {
+            if (!ChatOutbound::enqueue(client_fd, ChatCommands::Lane::Direct, page)) break;
+        }
+        return;
+    }
+
+    std::size_t page = 0;
+    try {
+        page = std::stoul(page_arg);
+    } catch (const std::exception&) {
+        page = 0;
+    }
+    if (page == 0 || page > pages->size()) {
+        ChatCommands::send_safe(client_fd, "Invalid page. There are " + std::to_string(pages->size()) + " page(s).\n",
+                                ChatCommands::Lane::Control);
+        return;
+    }
+    ChatOutbound::enqueue(client_fd, ChatCommands::Lane::Direct, (*pages)[page - 1]);
+}
+
+void handle_client(int client_fd, std::string peer_ip, std::uint64_t conn_id) {
+    ConnectionSlot slot{std::move(peer_ip), conn_id};
+    ChatOutbound::open(client_fd);
     std::string inbuf;
     std::string client_name;
 
@@ -164,39 +322,60 @@ void handle_client(int client_fd) {
         if (pop_line(inbuf, line)) {
             break; // Got a full line
         }
-        if (!recv_into_buffer(client_fd, inbuf)) { 
-            close(client_fd);
+        if (!recv_into_buffer(client_fd, inbuf, conn_id)) { 
+            close_client(client_fd);
             return; // Connection closed or error
         }
     }
 
-    client_name = sanitize_input(line);
+    std::vector<std::string> extensions;
+    bool handshake_ok = parse_handshake(sanitize_input(line), client_name, extensions);
 
-    if (!ChatCommands::is_valid_username(client_name)) {
+    if (!handshake_ok || !ChatCommands::is_valid_username(client_name)) {
         std::string error_msg = "Invalid username. Must be alphanumeric, underscore, or hyphen, and not empty or too long.\n";
-        ChatCommands::send_safe(client_fd, error_msg);
-        close(client_fd);
+        ChatCommands::send_safe(client_fd, error_msg, ChatCommands::Lane::Control);
+        close_client(client_fd);
         return;
     }
+
+    auto has_extension = [&extensions](const char* ext) {
+        return std::find(extensions.begin(), extensions.end(), ext) != extensions.end();
+    };
+
+    // Switch to shared-memory rings before the fd becomes visible to broadcasters
+    if (has_extension(ChatShm::HANDSHAKE_EXTENSION)) {
+        std::string error;
+        auto stream = ChatShm::offer(client_fd, error);
+        if (!stream) {
+            ChatCommands::send_safe(client_fd, "Shared-memory transport unavailable: " + error + "\n", ChatCommands::Lane::Control);
+            close_client(client_fd);
+            return;
+        }
+        ChatTransport::attach(client_fd, std::move(stream));
+    }
+    if (has_extension(ChatCompress::HANDSHAKE_EXTENSION)) {
+        ChatOutbound::enable_compression(client_fd);
+    }
     //Check duplicate username
     {
-        std::lock_guard<std::mutex> lock(m);
+        ChatSync::LockGuard lock(m);
         for (const auto& pair : client_names) {
             if (pair.second == client_name) {
                 std::string error_msg = "Username already taken. Please choose another one.\n";
-                ChatCommands::send_safe(client_fd, error_msg);
-                close(client_fd);
+                ChatCommands::send_safe(client_fd, error_msg, ChatCommands::Lane::Control);
+                close_client(client_fd);
                 return;
             }
         }
         client_names[client_fd] = client_name;
         clients.push_back(client_fd); // Add to clients list
+        ChatCommands::roster_changed();
     }
 
     // Announce client joining
     {
         std::string welcome_message = client_name + " has joined the chat.\n";
-        ChatCommands::send_safe(client_fd, welcome_message); // Send welcome message to the new client
+        ChatCommands::send_safe(client_fd, welcome_message, ChatCommands::Lane::Broadcast); // Send welcome message to the new client
         broadcast(welcome_message, client_fd);
     }
 
@@ -205,7 +384,9 @@ void handle_client(int client_fd) {
         // drain lines already in buffer
         std::string msg;
         while (pop_line(inbuf, msg)) {
+            TRACE_MESSAGE_SCOPE();
             msg = sanitize_input(msg);
+            TRACE_STAGE(Parse);
             if (msg.empty()) continue; // Ignore empty messages
 
             // Handle server-side command
@@ -221,8 +402,9 @@ void handle_client(int client_fd) {
                 } else {
                     // Unknown command
                     std::string error_msg = "Unknown command: " + command + "\n";
-                    ChatCommands::send_safe(client_fd, error_msg);
+                    ChatCommands::send_safe(client_fd, error_msg, ChatCommands::Lane::Control);
                 }
+                TRACE_STAGE(Dispatch);
 
                 continue;
             }
@@ -230,20 +412,21 @@ void handle_client(int client_fd) {
             // Handle standard message
             std::string name_snapshot;
             {
-                std::lock_guard<std::mutex> lock(m);
+                ChatSync::LockGuard lock(m);
                 auto it = client_names.find(client_fd);
                 name_snapshot = (it != client_names.end()) ? it->second : client_name;
             }
             std::string full_msg = get_time() + " " + name_snapshot + ": " + msg + "\n";
             if (full_msg.size() > ChatCommands::MAX_MESSAGE_LENGTH) {
-                ChatCommands::send_safe(client_fd, "Message too long. Max length is " + std::to_string(ChatCommands::MAX_MESSAGE_LENGTH) + " characters.\n");
+                ChatCommands::send_safe(client_fd, "Message too long. Max length is " + std::to_string(ChatCommands::MAX_MESSAGE_LENGTH) + " characters.\n", ChatCommands::Lane::Control);
                 continue;
         }
+            TRACE_STAGE(Dispatch);
             std::cout << full_msg;
             broadcast(full_msg, client_fd);
         }
 
-        if (!recv_into_buffer(client_fd, inbuf)) {
+        if (!recv_into_buffer(client_fd, inbuf, conn_id)) {
             std::cout << "Client " << client_name << " disconnected.\n";
             break; // Connection closed or error
         }
@@ -253,12 +436,13 @@ void handle_client(int client_fd) {
     // Cleanup after disconnection
     std::string name_snapshot;
     { 
-        std::lock_guard<std::mutex> lock(m);
+        ChatSync::LockGuard lock(m);
         auto it = client_names.find(client_fd);
         name_snapshot = (it != client_names.end()) ? it->second : client_name;
 
         clients.erase(std::remove(clients.begin(), clients.end(), client_fd), clients.end());
         client_names.erase(client_fd); // Remove from client names
+        ChatCommands::roster_changed();
     }
     {
         clear_fd_failures(client_fd); // Clear failures for this fd
@@ -267,17 +451,209 @@ void handle_client(int client_fd) {
     std::string full_message = get_time() + " " + name_snapshot + " has left the chat.\n";
     std::cout << full_message;
     broadcast(full_message, client_fd);
-    close(client_fd); // Close the client connection
+    close_client(client_fd); // Close the client connection
+}
+
+
+static void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--backlog N] [--max-clients N] [--max-per-ip N] [--sndbuf BYTES]\n"
+              << "       [--trace] [--trace-sample N] [--trace-dump FILE] [--capture FILE]\n"
+              << "       [--unix PATH]\n";
+}
+
+// Parses command line flags into config; returns false on bad input
+static bool parse_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--trace") {
+            config.trace = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+
+        if (arg == "--trace-dump") {
+            config.trace_dump = argv[++i];
+            continue;
+        }
+        if (arg == "--capture") {
+            config.capture = argv[++i];
+            continue;
+        }
+        if (arg == "--unix") {
+            config.unix_path = argv[++i];
+            if (config.unix_path.size() >= sizeof(sockaddr_un::sun_path)) {
+                std::cerr << "--unix path is too long.\n";
+                return false;
+            }
+            continue;
+        }
+
+        int* target = nullptr;
+        bool allow_zero = false;
+        if (arg == "--backlog") target = &config.backlog;
+        else if (arg == "--max-clients") target = &config.max_clients;
+        else if (arg == "--max-per-ip") target = &config.max_per_ip;
+        else if (arg == "--sndbuf") { target = &config.sndbuf; allow_zero = true; }
+        else if (arg == "--trace-sample") { target = &config.trace_sample; allow_zero = true; }
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+        try {
+            *target = std::stoi(argv[++i]);
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i] << "\n";
+            return false;
+        }
+        if (*target < 0 || (*target == 0 && !allow_zero)) {
+            std::cerr << arg << " must be positive.\n";
+            return false;
+        }
+    }
+
+    if ((config.trace_sample > 0 || !config.trace_dump.empty()) && !config.trace) {
+        std::cerr << "--trace-sample and --trace-dump require --trace.\n";
+        return false;
+    }
+    if (!config.trace_dump.empty() && config.trace_sample == 0) {
+        config.trace_sample = 100; // sample 1% when only a dump file is given
+    }
+#ifndef CHAT_TRACE
+    if (config.trace) {
+        std::cerr << "This server was built without tracing; rebuild with `make TRACE=1`.\n";
+        return false;
+    }
+#endif
+    return true;
 }
 
+void dump_stats() {
+    double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - server_start).count();
+    unsigned long long accepted = accept_stats.accepted.load();
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1)
+        << "---- server stats (uptime " << uptime << "s) ----\n"
+        << "open connections:  " << active_conns.load() << " / " << config.max_clients << "\n"
+        << "accepted:          " << accepted << " (" << (uptime > 0 ? accepted / uptime : 0.0) << "/s avg)\n"
+        << "rejected (full):   " << accept_stats.rejected_global.load() << "\n"
+        << "rejected (per-ip): " << accept_stats.rejected_per_ip.load() << "\n"
+        << "accept errors:     " << accept_stats.accept_errors.load() << "\n"
+        << "accept batches:    " << accept_stats.batches.load()
+        << " (largest " << accept_stats.max_batch.load() << ")\n";
+    if (config.trace) {
+        oss << ChatTrace::report();
+    }
+    oss << ChatOutbound::report();
+    oss << ChatCompress::report();
+    oss << ChatSync::report();
+    if (ChatCapture::enabled()) {
+        ChatCapture::flush();
+        oss << "capture:           " << ChatCapture::bytes_written() << " bytes to " << config.capture << "\n";
+    }
+    std::cout << oss.str() << std::flush;
+}
+
+// Best-effort one-shot rejection on a non-blocking socket; never stalls the accept loop
+static void reject_connection(int fd, const char* msg) {
+    ::send(fd, msg, std::strlen(msg), MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(fd);
+}
+
+// Reserves a connection slot for peer_ip, or returns the rejection message to send
+static const char* reserve_slot(const std::string& peer_ip) {
+    if (active_conns.load() >= config.max_clients) {
+        ++accept_stats.rejected_global;
+        return SERVER_FULL_MSG;
+    }
+    if (peer_ip != UNIX_PEER) {
+        ChatSync::LockGuard lock(conn_m);
+        int& count = conns_per_ip[peer_ip];
+        if (count >= config.max_per_ip) {
+            ++accept_stats.rejected_per_ip;
+            return TOO_MANY_FROM_MSG;
+        }
+        ++count;
+    }
+    ++active_conns;
+    return nullptr;
+}
+
+// Accepts every pending connection (up to accept_batch) on a non-blocking listener
+static void drain_accept_queue(int server_sock) {
+    unsigned long long batch = 0;
+    while (batch < static_cast<unsigned long long>(config.accept_batch)) {
+        sockaddr_storage peer{};
+        socklen_t peer_len = sizeof(peer);
+        int client_conn = accept4(server_sock, (sockaddr*)&peer, &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_conn < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break; // queue drained
+            if (errno == ECONNABORTED) continue;                 // peer gave up while queued
+            ++accept_stats.accept_errors;
+            std::cerr << "Failed to accept client connection: " << std::strerror(errno) << "\n";
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // Out of descriptors/memory: back off instead of spinning on a readable listener
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            break;
+        }
+        ++batch;
+
+        std::string peer_ip = UNIX_PEER;
+        if (peer.ss_family == AF_INET) {
+            char ip[INET_ADDRSTRLEN] = "?";
+            inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&peer)->sin_addr, ip, sizeof(ip));
+            peer_ip = ip;
+        }
+        std::uint64_t conn_id = next_conn_id++;
+        if (ChatCapture::enabled()) ChatCapture::record_connect(conn_id, peer_ip);
+
+        if (const char* rejection = reserve_slot(peer_ip)) {
+            reject_connection(client_conn, rejection);
+            if (ChatCapture::enabled()) ChatCapture::record_disconnect(conn_id);
+            continue;
+        }
+
+        ++accept_stats.accepted;
+        if (config.sndbuf > 0) {
+            setsockopt(client_conn, SOL_SOCKET, SO_SNDBUF, &config.sndbuf, sizeof(config.sndbuf));
+        }
+        std::thread(handle_client, client_conn, std::move(peer_ip), conn_id).detach();
+    }
+
+    if (batch > 0) {
+        ++accept_stats.batches;
+        if (batch > accept_stats.max_batch.load()) accept_stats.max_batch = batch;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (!parse_args(argc, argv)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (config.trace) {
+        ChatTrace::configure(true, static_cast<unsigned>(config.trace_sample), config.trace_dump);
+    }
+
+    if (!config.capture.empty() && !ChatCapture::open(config.capture)) {
+        std::cerr << "Failed to open capture file " << config.capture << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
 
-int main() {
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
+    std::signal(SIGUSR1, signal_handler); // Dump stats on demand
     std::signal(SIGPIPE, SIG_IGN); // Ignore broken pipe signals
 
-    // Server port/socket creation
-    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+    // Server port/socket creation (non-blocking so the accept loop can drain and still notice signals)
+    int server_sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
     if (server_sock < 0) {
         std::cerr << "Failed to create socket.\n";
@@ -303,28 +679,64 @@ int main() {
         close(server_sock);
         return 1;
     }
-    if (listen(server_sock, 10) < 0) {
+    if (listen(server_sock, config.backlog) < 0) {
         std::cerr << "Failed to listen on socket.\n";
         close(server_sock);
         return 1;
     }
 
-    std::cout << "Server listening on port... " << PORT << std::endl;
+    std::cout << "Server listening on port... " << PORT
+              << " (backlog " << config.backlog
+              << ", max clients " << config.max_clients
+              << ", max per ip " << config.max_per_ip << ")" << std::endl;
+
+    // Optional local listener for same-host clients (and the shared-memory transport)
+    int unix_sock = -1;
+    if (!config.unix_path.empty()) {
+        unix_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (unix_sock < 0) {
+            std::cerr << "Failed to create Unix socket.\n";
+            close(server_sock);
+            return 1;
+        }
+
+        sockaddr_un unix_addr{};
+        unix_addr.sun_family = AF_UNIX;
+        std::strncpy(unix_addr.sun_path, config.unix_path.c_str(), sizeof(unix_addr.sun_path) - 1);
+        unlink(config.unix_path.c_str()); // Remove a stale socket left by a previous run
+
+        if (bind(unix_sock, (struct sockaddr*)&unix_addr, sizeof(unix_addr)) < 0 ||
+            listen(unix_sock, config.backlog) < 0) {
+            std::cerr << "Failed to listen on Unix socket " << config.unix_path << ": " << std::strerror(errno) << "\n";
+            close(unix_sock);
+            close(server_sock);
+            return 1;
+        }
+        std::cout << "Server listening on Unix socket... " << config.unix_path << std::endl;
+    }
 
-    // Accept clients in a loop
+    ChatOutbound::start();
+    ChatCommands::set_send_hook(ChatOutbound::send_hook); // Route replies through the priority lanes
+    ChatCommands::unified_command_table["/who"].serverHandler = handle_who;
+
+    // Wait for a listener to become readable, then drain its accept queue
     while (!stop_server) {
-        int client_conn = accept(server_sock, nullptr, nullptr);
-        if (client_conn < 0) {
-            if (errno == EINTR) {                 // interrupted by signal
-                if (stop_server) break;           // asked to stop
-                continue;                         // try again
-            }
-            if (stop_server) break;
-            std::cerr << "Failed to accept client connection.\n";
-            continue;
+        if (dump_stats_requested) {
+            dump_stats_requested = false;
+            dump_stats();
         }
 
-        std::thread(handle_client, client_conn).detach();
+        pollfd pfds[2] = {{server_sock, POLLIN, 0}, {unix_sock, POLLIN, 0}};
+        int ready = poll(pfds, unix_sock >= 0 ? 2 : 1, 1000);
+        if (ready < 0) {
+            if (errno == EINTR) continue;         // interrupted by signal; loop re-checks flags
+            std::cerr << "Failed to poll listening socket: " << std::strerror(errno) << "\n";
+            break;
+        }
+        if (ready == 0) continue;
+
+        if (pfds[0].revents & POLLIN) drain_accept_queue(server_sock);
+        if (unix_sock >= 0 && (pfds[1].revents & POLLIN)) drain_accept_queue(unix_sock);
     }
 
     std::cout << "Server shutting down...\n";
@@ -332,31 +744,44 @@ int main() {
         print_signal_message(last_signal);
     }
     close(server_sock);
+    if (unix_sock >= 0) {
+        close(unix_sock);
+        unlink(config.unix_path.c_str());
+    }
+    dump_stats();
+    if (config.trace && !ChatTrace::write_chrome_trace()) {
+        std::cerr << "Failed to write trace dump to " << config.trace_dump << "\n";
+    }
 
     // Snapshot under lock
     std::vector<int> fds;
     {
-        std::lock_guard<std::mutex> lock(m);
+        ChatSync::LockGuard lock(m);
         fds = clients; // Get current client fds
     }
 
-    // Send without blocking
+    // Queue the goodbye ahead of any backlog, give the lanes a moment to drain, then hang up
+    for (int fd : fds) {
+        ChatCommands::send_safe(fd, "Server is shutting down. Goodbye!\n", ChatCommands::Lane::Control);
+    }
+    ChatOutbound::stop(1000);
     for (int fd : fds) {
-        ChatCommands::send_safe(fd, "Server is shutting down. Goodbye!\n");
         shutdown(fd, SHUT_RDWR); // Shutdown the client socket
     }
 
     // Prune under lock
     {
-        std::lock_guard<std::mutex> lock(m);
+        ChatSync::LockGuard lock(m);
         clients.clear(); // Clear the client list
         client_names.clear(); // Clear client names
+        ChatCommands::roster_changed();
     }
     {
-        std::lock_guard<std::mutex> send_lock(send_m);
+        ChatSync::LockGuard send_lock(send_m);
         send_failures.clear(); // Clear send failures
 
     }
+    ChatCapture::close();
 
     return 0;
 }
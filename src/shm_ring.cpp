@@ -0,0 +1,341 @@
+#include "shm_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace ChatShm {
+
+namespace {
+    constexpr std::uint32_t SEGMENT_MAGIC   = 0x43485348; // "CHSH"
+    constexpr std::uint32_t SEGMENT_VERSION = 1;
+    constexpr const char*   OFFER_PAYLOAD   = "shm\n";
+
+    static_assert((RING_CAPACITY & (RING_CAPACITY - 1)) == 0, "RING_CAPACITY must be a power of two");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "ring indices must be lock-free to live in shared memory");
+
+    // Indices count bytes ever written/read, so head - tail is the fill level
+    struct RingHeader {
+        alignas(64) std::atomic<std::uint64_t> head{0};           // advanced by the producer
+        alignas(64) std::atomic<std::uint64_t> tail{0};           // advanced by the consumer
+        alignas(64) std::atomic<std::uint32_t> reader_waiting{0}; // consumer is (about to be) asleep on its eventfd
+    };
+
+    struct Segment {
+        std::uint32_t magic;
+        std::uint32_t version;
+        RingHeader    to_server_hdr;
+        RingHeader    to_client_hdr;
+        char          to_server[RING_CAPACITY];
+        char          to_client[RING_CAPACITY];
+    };
+
+    // One end of the ring pair. Reads come from a single thread (the connection's reader);
+    // writes may come from any thread and are serialized by tx_m_ to keep the ring SPSC.
+    class RingStream : public ChatTransport::Stream {
+    public:
+        RingStream(Segment* seg, bool server_side, int my_efd, int peer_efd, int sock)
+            : seg_(seg),
+              rx_hdr_(server_side ? &seg->to_server_hdr : &seg->to_client_hdr),
+              tx_hdr_(server_side ? &seg->to_client_hdr : &seg->to_server_hdr),
+              rx_(server_side ? seg->to_server : seg->to_client),
+              tx_(server_side ? seg->to_client : seg->to_server),
+              my_efd_(my_efd), peer_efd_(peer_efd), sock_(sock) {}
+
+        ~RingStream() override {
+            munmap(seg_, sizeof(Segment));
+            close(my_efd_);
+            close(peer_efd_);
+        }
+
+        ssize_t read_some(char* buf, size_t len) override {
+            std::uint64_t tail = rx_hdr_->tail.load(std::memory_order_relaxed);
+            std::uint64_t head = rx_hdr_->head.load(std::memory_order_acquire);
+            std::size_t avail = static_cast<std::size_t>(head - tail);
+            if (avail == 0) {
+                if (peer_gone_) return 0; // drained everything the peer sent before leaving
+                errno = EAGAIN;
+                return -1;
+            }
+            std::size_t n = std::min(len, avail);
+            copy_out(buf, rx_, tail, n);
+            rx_hdr_->tail.store(tail + n, std::memory_order_release);
+            return static_cast<ssize_t>(n);
+        }
+
+        ssize_t write_some(const char* buf, size_t len) override {
+            if (peer_gone_) {
+                errno = EPIPE;
+                return -1;
+            }
+            std::size_t n;
+            {
+                std::lock_guard<std::mutex> lock(tx_m_);
+                std::uint64_t head = tx_hdr_->head.load(std::memory_order_relaxed);
+                std::uint64_t tail = tx_hdr_->tail.load(std::memory_order_acquire);
+                std::size_t space = RING_CAPACITY - static_cast<std::size_t>(head - tail);
+                if (space == 0) {
+                    errno = EAGAIN;
+                    return -1;
+                }
+                n = std::min(len, space);
+                copy_in(tx_, head, buf, n);
+                tx_hdr_->head.store(head + n, std::memory_order_release);
+            }
+            // Pairs with the fence in wait_readable: either the reader sees the new head
+            // before sleeping, or we see its waiting flag and wake it. No syscall otherwise.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (tx_hdr_->reader_waiting.load(std::memory_order_relaxed)) {
+                eventfd_write(peer_efd_, 1);
+            }
+            return static_cast<ssize_t>(n);
+        }
+
+        bool wait_readable(int timeout_ms) override {
+            if (has_data() || peer_gone_) return true;
+
+            rx_hdr_->reader_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (has_data()) {
+                rx_hdr_->reader_waiting.store(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            pollfd pfds[2] = {{my_efd_, POLLIN, 0}, {sock_, POLLIN, 0}};
+            int ready = poll(pfds, 2, timeout_ms);
+            rx_hdr_->reader_waiting.store(0, std::memory_order_relaxed);
+            if (ready < 0) return errno != EINTR;
+            if (pfds[0].revents & POLLIN) {
+                eventfd_t ignored;
+                eventfd_read(my_efd_, &ignored); // reset the counter; the ring is the source of truth
+            }
+            if (pfds[1].revents) check_peer();
+            return ready > 0;
+        }
+
+        // There is no eventfd for "space freed", so a full ring is waited out with a short
+        // backoff. Rings are large enough that this only happens when the peer stalls.
+        bool wait_writable(int timeout_ms) override {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            auto backoff = std::chrono::microseconds(50);
+            for (;;) {
+                if (has_space() || peer_gone_) return true;
+                if (check_peer()) return true;
+                if (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline) return false;
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min(backoff * 2, std::chrono::microseconds(1000));
+            }
+        }
+
+    private:
+        bool has_data() const {
+            return rx_hdr_->head.load(std::memory_order_acquire) != rx_hdr_->tail.load(std::memory_order_relaxed);
+        }
+
+        bool has_space() const {
+            return tx_hdr_->head.load(std::memory_order_relaxed) - tx_hdr_->tail.load(std::memory_order_acquire) < RING_CAPACITY;
+        }
+
+        // The socket carries no data after the handshake, so readable means EOF or error
+        bool check_peer() {
+            char c;
+            ssize_t n = recv(sock_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                peer_gone_ = true;
+            }
+            return peer_gone_;
+        }
+
+        static void copy_in(char* ring, std::uint64_t pos, const char* src, std::size_t n) {
+            std::size_t off = static_cast<std::size_t>(pos & (RING_CAPACITY - 1));
+            std::size_t first = std::min(n, RING_CAPACITY - off);
+            std::memcpy(ring + off, src, first);
+            std::memcpy(ring, src + first, n - first);
+        }
+
+        static void copy_out(char* dst, const char* ring, std::uint64_t pos, std::size_t n) {
+            std::size_t off = static_cast<std::size_t>(pos & (RING_CAPACITY - 1));
+            std::size_t first = std::min(n, RING_CAPACITY - off);
+            std::memcpy(dst, ring + off, first);
+            std::memcpy(dst + first, ring, n - first);
+        }
+
+        Segment*    seg_;
+        RingHeader* rx_hdr_;
+        RingHeader* tx_hdr_;
+        char*       rx_;
+        char*       tx_;
+        int         my_efd_;
+        int         peer_efd_;
+        int         sock_;
+        std::mutex  tx_m_;
+        std::atomic<bool> peer_gone_{false};
+    };
+
+    Segment* map_segment(int memfd) {
+        void* p = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        return p == MAP_FAILED ? nullptr : static_cast<Segment*>(p);
+    }
+
+    std::string errno_text(const char* what) {
+        return std::string(what) + ": " + std::strerror(errno);
+    }
+}
+
+std::shared_ptr<ChatTransport::Stream> offer(int sock, std::string& error) {
+    int domain = 0;
+    socklen_t domain_len = sizeof(domain);
+    if (getsockopt(sock, SOL_SOCKET, SO_DOMAIN, &domain, &domain_len) < 0 || domain != AF_UNIX) {
+        error = "shared-memory transport requires a Unix socket connection";
+        return nullptr;
+    }
+
+    int memfd = memfd_create("simple-chat-ring", MFD_CLOEXEC);
+    if (memfd < 0) {
+        error = errno_text("memfd_create");
+        return nullptr;
+    }
+    if (ftruncate(memfd, sizeof(Segment)) < 0) {
+        error = errno_text("ftruncate");
+        close(memfd);
+        return nullptr;
+    }
+    Segment* seg = map_segment(memfd);
+    if (!seg) {
+        error = errno_text("mmap");
+        close(memfd);
+        return nullptr;
+    }
+    new (&seg->to_server_hdr) RingHeader();
+    new (&seg->to_client_hdr) RingHeader();
+    seg->magic = SEGMENT_MAGIC;
+    seg->version = SEGMENT_VERSION;
+
+    int server_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int client_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server_efd < 0 || client_efd < 0) {
+        error = errno_text("eventfd");
+        if (server_efd >= 0) close(server_efd);
+        if (client_efd >= 0) close(client_efd);
+        munmap(seg, sizeof(Segment));
+        close(memfd);
+        return nullptr;
+    }
+
+    // Ship [memfd, server_efd, client_efd] along with a short marker line
+    int fds[3] = {memfd, server_efd, client_efd};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec iov{const_cast<char*>(OFFER_PAYLOAD), std::strlen(OFFER_PAYLOAD)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent;
+    for (;;) {
+        sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd pfd{sock, POLLOUT, 0};
+            poll(&pfd, 1, 1000);
+            continue;
+        }
+        break;
+    }
+    close(memfd); // our mapping keeps the segment alive
+    if (sent != static_cast<ssize_t>(iov.iov_len)) {
+        error = sent < 0 ? errno_text("sendmsg") : "short sendmsg";
+        close(server_efd);
+        close(client_efd);
+        munmap(seg, sizeof(Segment));
+        return nullptr;
+    }
+
+    return std::make_shared<RingStream>(seg, true, server_efd, client_efd, sock);
+}
+
+std::shared_ptr<ChatTransport::Stream> accept_offer(int sock, std::string& reply, std::string& error) {
+    int fds[3] = {-1, -1, -1};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    char buf[1024];
+    iovec iov{buf, sizeof(buf)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        error = errno_text("recvmsg");
+        return nullptr;
+    }
+    if (n == 0) {
+        error = "server closed the connection";
+        return nullptr;
+    }
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        reply.assign(buf, static_cast<size_t>(n)); // plain answer, e.g. a rejection
+        return nullptr;
+    }
+    std::size_t nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::memcpy(fds, CMSG_DATA(cmsg), std::min(nfds, std::size_t{3}) * sizeof(int));
+    auto close_all = [&]() {
+        for (std::size_t i = 0; i < nfds && i < 3; ++i) close(fds[i]);
+    };
+    if (nfds != 3 || (msg.msg_flags & MSG_CTRUNC)) {
+        error = "malformed shared-memory offer";
+        close_all();
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fds[0], &st) < 0 || static_cast<std::size_t>(st.st_size) != sizeof(Segment)) {
+        error = "shared-memory segment has unexpected size (server/client version mismatch?)";
+        close_all();
+        return nullptr;
+    }
+    Segment* seg = map_segment(fds[0]);
+    close(fds[0]);
+    if (!seg) {
+        error = errno_text("mmap");
+        close(fds[1]);
+        close(fds[2]);
+        return nullptr;
+    }
+    if (seg->magic != SEGMENT_MAGIC || seg->version != SEGMENT_VERSION) {
+        error = "shared-memory segment version mismatch";
+        munmap(seg, sizeof(Segment));
+        close(fds[1]);
+        close(fds[2]);
+        return nullptr;
+    }
+
+    return std::make_shared<RingStream>(seg, false, fds[2], fds[1], sock);
+}
+
+} // namespace ChatShm
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "transport.h"
+
+// Shared-memory transport for clients on the same host as the server.
+//
+// A client connects over the server's AF_UNIX socket and appends HANDSHAKE_EXTENSION to
+// its username line. The server answers with SCM_RIGHTS carrying a memfd holding two
+// single-producer/single-consumer byte rings (one per direction) and two eventfds used
+// as wakeups. From then on all chat traffic flows through the rings; the Unix socket
+// stays open only so either side can notice the other going away.
+
+namespace ChatShm {
+
+    constexpr std::size_t RING_CAPACITY      = 1 << 20; // bytes per direction, power of two
+    constexpr const char* HANDSHAKE_EXTENSION = "+shm";
+
+    // Server side: creates the rings, hands them to the peer over the Unix socket `sock`
+    // and returns the server's end. Returns nullptr with `error` set on failure.
+    std::shared_ptr<ChatTransport::Stream> offer(int sock, std::string& error);
+
+    // Client side: waits for the server's answer on `sock`. If the server replied with
+    // plain text instead (e.g. a rejection), returns nullptr and leaves it in `reply`.
+    std::shared_ptr<ChatTransport::Stream> accept_offer(int sock, std::string& reply, std::string& error);
+
+} // namespace ChatShm
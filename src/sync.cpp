@@ -0,0 +1,137 @@
+#include "sync.h"
+
+#ifdef CHAT_LOCK_STATS
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace ChatSync {
+
+namespace {
+    // Leaked, so mutexes with static storage can also unregister in any order
+    struct Registry {
+        std::mutex m;
+        std::vector<InstrumentedMutex*> mutexes;
+    };
+
+    Registry& registry() {
+        static Registry& r = leak<Registry>();
+        return r;
+    }
+
+    using ChatStats::now_ns;
+
+    const char* basename_of(const char* path) {
+        const char* slash = std::strrchr(path, '/');
+        return slash ? slash + 1 : path;
+    }
+}
+
+InstrumentedMutex::InstrumentedMutex(const char* name) : name_(name) {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.m);
+    r.mutexes.push_back(this);
+}
+
+InstrumentedMutex::~InstrumentedMutex() {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.m);
+    r.mutexes.erase(std::remove(r.mutexes.begin(), r.mutexes.end(), this), r.mutexes.end());
+}
+
+void InstrumentedMutex::lock(const char* file, int line) {
+    if (m_.try_lock()) {
+        on_acquired(file, line, 0, false);
+        return;
+    }
+    std::uint64_t start = now_ns();
+    m_.lock();
+    on_acquired(file, line, now_ns() - start, true);
+}
+
+bool InstrumentedMutex::try_lock(const char* file, int line) {
+    if (!m_.try_lock()) return false;
+    on_acquired(file, line, 0, false);
+    return true;
+}
+
+void InstrumentedMutex::unlock() {
+    std::uint64_t held = now_ns() - acquired_at_;
+    hold_.record(held);
+    sites_[holder_site_].hold_ns += held;
+    m_.unlock();
+}
+
+void InstrumentedMutex::on_acquired(const char* file, int line, std::uint64_t wait_ns, bool contended) {
+    // Call sites are few and fixed, so a linear scan beats hashing here
+    std::size_t idx = 0;
+    while (idx < sites_.size() && !(sites_[idx].line == line && sites_[idx].file == file)) ++idx;
+    if (idx == sites_.size()) sites_.push_back(CallSite{file, line});
+
+    CallSite& site = sites_[idx];
+    ++site.acquires;
+    site.wait_ns += wait_ns;
+    if (contended) {
+        ++site.contended;
+        ++contended_;
+    }
+    ++acquires_;
+    wait_.record(wait_ns);
+
+    holder_site_ = idx;
+    acquired_at_ = now_ns();
+}
+
+std::string InstrumentedMutex::report() {
+    std::vector<CallSite> sites;
+    std::uint64_t acquires, contended;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        sites = sites_;
+        acquires = acquires_;
+        contended = contended_;
+    }
+    std::sort(sites.begin(), sites.end(), [](const CallSite& a, const CallSite& b) {
+        return a.wait_ns != b.wait_ns ? a.wait_ns > b.wait_ns : a.acquires > b.acquires;
+    });
+
+    std::ostringstream oss;
+    oss << "mutex " << name_ << ": " << acquires << " acquires, " << contended << " contended\n"
+        << ChatStats::report_row("wait", wait_) << "\n"
+        << ChatStats::report_row("hold", hold_) << "\n";
+    for (const auto& s : sites) {
+        oss << "  " << basename_of(s.file) << ":" << s.line
+            << " acquires=" << s.acquires
+            << " contended=" << s.contended
+            << " wait=" << ChatStats::Histogram::format_ns(s.wait_ns)
+            << " hold=" << ChatStats::Histogram::format_ns(s.hold_ns) << "\n";
+    }
+    return oss.str();
+}
+
+std::string report() {
+    std::vector<InstrumentedMutex*> mutexes;
+    {
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.m);
+        mutexes = r.mutexes;
+    }
+    std::string out = "lock contention:\n";
+    for (InstrumentedMutex* mx : mutexes) out += mx->report();
+    return out;
+}
+
+} // namespace ChatSync
+
+#else
+
+namespace ChatSync {
+
+std::string report() {
+    return "";
+}
+
+} // namespace ChatSync
+
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef CHAT_LOCK_STATS
+#include "histogram.h"
+#endif
+
+// Mutex types for shared server state.
+// Build with `make LOCKSTATS=1` (defines CHAT_LOCK_STATS) to swap in InstrumentedMutex,
+// which records acquire counts, wait/hold time histograms and per-call-site totals.
+// Otherwise Mutex is a plain std::mutex and LockGuard a plain std::lock_guard.
+
+namespace ChatSync {
+
+#ifdef CHAT_LOCK_STATS
+
+    class InstrumentedMutex {
+    public:
+        explicit InstrumentedMutex(const char* name);
+        ~InstrumentedMutex();
+        InstrumentedMutex(const InstrumentedMutex&) = delete;
+        InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+
+        // Default arguments capture the caller's location (GCC/Clang builtins)
+        void lock(const char* file = __builtin_FILE(), int line = __builtin_LINE());
+        bool try_lock(const char* file = __builtin_FILE(), int line = __builtin_LINE());
+        void unlock();
+
+        std::string report();
+
+    private:
+        struct CallSite {
+            const char*   file;
+            int           line;
+            std::uint64_t acquires  = 0;
+            std::uint64_t contended = 0;
+            std::uint64_t wait_ns   = 0;
+            std::uint64_t hold_ns   = 0;
+        };
+
+        void on_acquired(const char* file, int line, std::uint64_t wait_ns, bool contended);
+
+        std::mutex  m_;
+        const char* name_;
+
+        // Written only while m_ is held
+        std::uint64_t          acquired_at_ = 0;
+        std::size_t            holder_site_ = 0;
+        std::uint64_t          acquires_    = 0;
+        std::uint64_t          contended_   = 0;
+        ChatStats::Histogram   wait_;
+        ChatStats::Histogram   hold_;
+        std::vector<CallSite>  sites_;
+    };
+
+    // std::lock_guard replacement that forwards the caller's location to lock()
+    class LockGuard {
+    public:
+        explicit LockGuard(InstrumentedMutex& m, const char* file = __builtin_FILE(), int line = __builtin_LINE())
+            : m_(m) { m_.lock(file, line); }
+        ~LockGuard() { m_.unlock(); }
+        LockGuard(const LockGuard&) = delete;
+        LockGuard& operator=(const LockGuard&) = delete;
+    private:
+        InstrumentedMutex& m_;
+    };
+
+    using Mutex = InstrumentedMutex;
+
+#else
+
+    class Mutex : public std::mutex {
+    public:
+        explicit Mutex(const char* = "") {}
+    };
+
+    using LockGuard = std::lock_guard<Mutex>;
+
+#endif
+
+    // Contention report for every instrumented mutex (empty when not compiled in)
+    std::string report();
+
+    // Allocates a T that is never destroyed. Shared state touched by detached client
+    // threads lives in one of these: those threads may still be running while static
+    // destructors run at exit.
+    template <typename T, typename... Args>
+    T& leak(Args&&... args) {
+        return *new T(std::forward<Args>(args)...);
+    }
+
+} // namespace ChatSync
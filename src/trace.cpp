@@ -0,0 +1,198 @@
+#include "trace.h"
+#include "histogram.h"
+#include "sync.h"
+
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ChatTrace {
+
+std::atomic<bool> g_enabled{false};
+
+using ChatStats::now_ns;
+
+namespace {
+    constexpr int STAGES = static_cast<int>(Stage::Count);
+    constexpr std::size_t MAX_TRACE_EVENTS = 200000; // cap on buffered Chrome trace events
+
+    const char* const stage_names[STAGES] = {"recv", "parse", "dispatch", "snapshot", "enqueue"};
+
+    struct StageHistograms {
+        ChatStats::Histogram stage[STAGES];
+        ChatStats::Histogram total;
+    };
+
+    struct TraceEvent {
+        int stage;
+        unsigned tid;
+        std::uint64_t start_ns;
+        std::uint64_t dur_ns;
+    };
+
+    struct Registry {
+        std::mutex m;
+        std::vector<StageHistograms*> live; // one per running thread
+        StageHistograms retired;            // merged from threads that have exited
+        std::vector<TraceEvent> events;
+        std::uint64_t dropped_events = 0;
+        std::string dump_path;
+        unsigned next_tid = 1;
+    };
+
+    Registry& registry() {
+        static Registry& r = ChatSync::leak<Registry>();
+        return r;
+    }
+
+    std::atomic<unsigned> sample_every{0};
+    std::atomic<std::uint64_t> message_seq{0};
+    const std::uint64_t trace_epoch = now_ns();
+
+    // Histograms owned by the registry; the thread only keeps a pointer and hands
+    // its counts over to `retired` when it exits.
+    struct ThreadSlot {
+        StageHistograms* hists = nullptr;
+        unsigned tid = 0;
+
+        StageHistograms& get() {
+            if (!hists) {
+                auto& r = registry();
+                std::lock_guard<std::mutex> lock(r.m);
+                hists = new StageHistograms();
+                tid = r.next_tid++;
+                r.live.push_back(hists);
+            }
+            return *hists;
+        }
+
+        ~ThreadSlot() {
+            if (!hists) return;
+            auto& r = registry();
+            std::lock_guard<std::mutex> lock(r.m);
+            for (int i = 0; i < STAGES; ++i) r.retired.stage[i].merge(hists->stage[i]);
+            r.retired.total.merge(hists->total);
+            for (auto it = r.live.begin(); it != r.live.end(); ++it) {
+                if (*it == hists) { r.live.erase(it); break; }
+            }
+            delete hists;
+        }
+    };
+
+    struct MessageState {
+        bool active = false;
+        bool sampled = false;
+        std::uint64_t recv_ns = 0;
+        std::uint64_t stamps[STAGES] = {};
+    };
+
+    thread_local ThreadSlot slot;
+    thread_local MessageState current;
+    thread_local std::uint64_t last_recv_ns = 0;
+}
+
+void configure(bool enable, unsigned every, const std::string& dump_path) {
+    {
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.m);
+        r.dump_path = dump_path;
+    }
+    sample_every = every;
+    g_enabled = enable;
+}
+
+void note_recv() {
+    last_recv_ns = now_ns();
+}
+
+void begin_message() {
+    current = MessageState{};
+    current.active = true;
+    current.recv_ns = last_recv_ns ? last_recv_ns : now_ns();
+    unsigned every = sample_every.load(std::memory_order_relaxed);
+    if (every) current.sampled = (message_seq.fetch_add(1, std::memory_order_relaxed) % every) == 0;
+    stamp(Stage::Recv);
+}
+
+void stamp(Stage stage) {
+    if (!current.active) return;
+    current.stamps[static_cast<int>(stage)] = now_ns();
+}
+
+void end_message() {
+    if (!current.active) return;
+    current.active = false;
+
+    StageHistograms& h = slot.get();
+    std::vector<TraceEvent> sampled;
+    std::uint64_t prev = current.recv_ns;
+    for (int i = 0; i < STAGES; ++i) {
+        std::uint64_t t = current.stamps[i];
+        if (!t) continue; // stage skipped (e.g. commands never broadcast)
+        std::uint64_t dur = t > prev ? t - prev : 0;
+        h.stage[i].record(dur);
+        if (current.sampled) sampled.push_back({i, slot.tid, prev, dur});
+        prev = t;
+    }
+    h.total.record(prev > current.recv_ns ? prev - current.recv_ns : 0);
+
+    if (!sampled.empty()) {
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.m);
+        for (const auto& ev : sampled) {
+            if (r.events.size() < MAX_TRACE_EVENTS) r.events.push_back(ev);
+            else ++r.dropped_events;
+        }
+    }
+}
+
+std::string report() {
+    StageHistograms merged;
+    {
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.m);
+        for (int i = 0; i < STAGES; ++i) merged.stage[i].merge(r.retired.stage[i]);
+        merged.total.merge(r.retired.total);
+        for (const StageHistograms* h : r.live) {
+            for (int i = 0; i < STAGES; ++i) merged.stage[i].merge(h->stage[i]);
+            merged.total.merge(h->total);
+        }
+    }
+
+    std::ostringstream oss;
+    oss << "message latency by stage:\n";
+    for (int i = 0; i < STAGES; ++i) {
+        oss << ChatStats::report_row(stage_names[i], merged.stage[i]) << "\n";
+    }
+    oss << ChatStats::report_row("total", merged.total) << "\n";
+    return oss.str();
+}
+
+bool write_chrome_trace() {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.m);
+    if (r.dump_path.empty()) return true;
+
+    std::ofstream out(r.dump_path);
+    if (!out) return false;
+
+    // Chrome trace-event format: complete ("X") events, timestamps in microseconds
+    out << "{\"traceEvents\":[\n";
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    bool first = true;
+    for (const auto& ev : r.events) {
+        if (!first) out << ",\n";
+        first = false;
+        out << "{\"name\":\"" << stage_names[ev.stage] << "\",\"cat\":\"message\",\"ph\":\"X\""
+            << ",\"pid\":1,\"tid\":" << ev.tid
+            << ",\"ts\":" << (ev.start_ns - trace_epoch) / 1e3
+            << ",\"dur\":" << ev.dur_ns / 1e3 << "}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":" << r.dropped_events << "}}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace ChatTrace
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Per-message latency tracing for the server pipeline.
+// Build with `make TRACE=1` (defines CHAT_TRACE) to compile the probes in; without it
+// every TRACE_* macro expands to nothing. When compiled in, probes cost one relaxed load
+// until tracing is switched on at runtime.
+
+namespace ChatTrace {
+
+    // Pipeline stages, in order. Each stamp marks the END of that stage.
+    enum class Stage : int {
+        Recv,     // bytes arrived -> line popped from the input buffer
+        Parse,    // sanitize_input
+        Dispatch, // command handler or chat line formatting
+        Snapshot, // broadcast() copying the client list
+        Enqueue,  // fan-out onto each recipient's broadcast lane (socket writes are in the lane stats)
+        Count
+    };
+
+    extern std::atomic<bool> g_enabled;
+    inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+    // sample_every: dump one in N messages to the Chrome trace (0 disables the dump)
+    void configure(bool enable, unsigned sample_every, const std::string& dump_path);
+
+    void note_recv();     // remember when the current thread last received bytes
+    void begin_message(); // a full line was popped; starts its trace
+    void stamp(Stage stage);
+    void end_message();   // folds the finished trace into this thread's histograms
+
+    std::string report();     // per-stage histograms merged across threads
+    bool write_chrome_trace(); // writes sampled events to dump_path (no-op if unset)
+
+    // Ends the current message trace on every exit path out of a loop body
+    struct MessageScope {
+        bool active;
+        MessageScope() : active(enabled()) { if (active) begin_message(); }
+        ~MessageScope() { if (active) end_message(); }
+        MessageScope(const MessageScope&) = delete;
+        MessageScope& operator=(const MessageScope&) = delete;
+    };
+
+} // namespace ChatTrace
+
+#ifdef CHAT_TRACE
+#define TRACE_NOTE_RECV()     do { if (ChatTrace::enabled()) ChatTrace::note_recv(); } while (0)
+#define TRACE_MESSAGE_SCOPE() ChatTrace::MessageScope chat_trace_scope_
+#define TRACE_STAGE(s)        do { if (ChatTrace::enabled()) ChatTrace::stamp(ChatTrace::Stage::s); } while (0)
+#else
+#define TRACE_NOTE_RECV()     do {} while (0)
+#define TRACE_MESSAGE_SCOPE() do {} while (0)
+#define TRACE_STAGE(s)        do {} while (0)
+#endif
@@ -0,0 +1,80 @@
+#include "transport.h"
+#include "sync.h"
+
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace ChatTransport {
+
+namespace {
+    struct Registry {
+        std::shared_mutex m;
+        std::unordered_map<int, std::shared_ptr<Stream>> streams;
+    };
+
+    Registry& registry() {
+        static Registry& r = ChatSync::leak<Registry>();
+        return r;
+    }
+
+    // Lets plain-socket I/O skip the registry lookup entirely while nothing is attached
+    std::atomic<int> attached{0};
+
+    bool poll_fd(int fd, short events, int timeout_ms) {
+        pollfd pfd{fd, events, 0};
+        for (;;) {
+            int ready = poll(&pfd, 1, timeout_ms);
+            if (ready > 0) return true;
+            if (ready == 0) return false;
+            if (errno != EINTR) return true; // let the next recv/send report the error
+        }
+    }
+}
+
+void attach(int fd, std::shared_ptr<Stream> stream) {
+    auto& r = registry();
+    std::unique_lock<std::shared_mutex> lock(r.m);
+    if (r.streams.insert_or_assign(fd, std::move(stream)).second) ++attached;
+}
+
+void detach(int fd) {
+    auto& r = registry();
+    std::unique_lock<std::shared_mutex> lock(r.m);
+    if (r.streams.erase(fd)) --attached;
+}
+
+std::shared_ptr<Stream> find(int fd) {
+    if (attached.load(std::memory_order_relaxed) == 0) return nullptr;
+    auto& r = registry();
+    std::shared_lock<std::shared_mutex> lock(r.m);
+    auto it = r.streams.find(fd);
+    return it != r.streams.end() ? it->second : nullptr;
+}
+
+ssize_t recv_some(int fd, char* buf, size_t len) {
+    if (auto stream = find(fd)) return stream->read_some(buf, len);
+    return ::recv(fd, buf, len, 0);
+}
+
+ssize_t send_some(int fd, const char* buf, size_t len) {
+    if (auto stream = find(fd)) return stream->write_some(buf, len);
+    return ::send(fd, buf, len, 0);
+}
+
+bool wait_readable(int fd, int timeout_ms) {
+    if (auto stream = find(fd)) return stream->wait_readable(timeout_ms);
+    return poll_fd(fd, POLLIN, timeout_ms);
+}
+
+bool wait_writable(int fd, int timeout_ms) {
+    if (auto stream = find(fd)) return stream->wait_writable(timeout_ms);
+    return poll_fd(fd, POLLOUT, timeout_ms);
+}
+
+} // namespace ChatTransport
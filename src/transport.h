@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <sys/types.h>
+
+// Byte-stream I/O keyed by connection fd.
+// Plain sockets go straight to recv/send. A connection that negotiated a different
+// transport (e.g. the shared-memory rings in shm_ring.h) attaches a Stream to its
+// socket fd, and every caller below is routed to it transparently.
+
+namespace ChatTransport {
+
+    // Same conventions as recv/send: read_some returns 0 on EOF, and both return -1
+    // with errno set (EAGAIN when they would block). Neither call ever blocks.
+    class Stream {
+    public:
+        virtual ~Stream() = default;
+        virtual ssize_t read_some(char* buf, size_t len) = 0;
+        virtual ssize_t write_some(const char* buf, size_t len) = 0;
+        // Return false on timeout (timeout_ms < 0 waits forever)
+        virtual bool wait_readable(int timeout_ms) = 0;
+        virtual bool wait_writable(int timeout_ms) = 0;
+    };
+
+    void attach(int fd, std::shared_ptr<Stream> stream);
+    void detach(int fd); // call before close(fd) so the number can't alias a new connection
+    std::shared_ptr<Stream> find(int fd);
+
+    // recv/send on plain sockets (honouring their blocking mode), Stream calls otherwise
+    ssize_t recv_some(int fd, char* buf, size_t len);
+    ssize_t send_some(int fd, const char* buf, size_t len);
+    bool wait_readable(int fd, int timeout_ms);
+    bool wait_writable(int fd, int timeout_ms);
+
+} // namespace ChatTransport
@@ -0,0 +1,185 @@
+// Round-trip and malformed-input checks for the LZ4 codec and frame format (`make test`)
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "compress.h"
+
+using ChatCompress::DecodeResult;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                       \
+    do {                                                                  \
+        if (!(cond)) {                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                   \
+        }                                                                 \
+    } while (0)
+
+static std::string compress(const std::string& in) {
+    std::string out(ChatCompress::max_compressed_size(in.size()), '\0');
+    out.resize(ChatCompress::compress_block(in.data(), in.size(), &out[0]));
+    CHECK(out.size() <= ChatCompress::max_compressed_size(in.size()));
+    return out;
+}
+
+static bool decompress(const std::string& block, std::size_t out_len, std::string& out) {
+    out.assign(out_len, '\0');
+    return ChatCompress::decompress_block(block.data(), block.size(), &out[0], out_len);
+}
+
+static void check_round_trip(const std::string& in) {
+    std::string out;
+    CHECK(decompress(compress(in), in.size(), out));
+    CHECK(out == in);
+}
+
+static std::string random_bytes(std::mt19937& rng, std::size_t len) {
+    std::string s(len, '\0');
+    for (auto& c : s) c = static_cast<char>(rng() & 0xff);
+    return s;
+}
+
+static void test_empty() {
+    check_round_trip("");
+    CHECK(ChatCompress::encode_frame("").empty());
+
+    std::size_t consumed = 0;
+    std::string text;
+    CHECK(ChatCompress::decode_frame("", 0, consumed, text) == DecodeResult::NeedMore);
+}
+
+static void test_incompressible() {
+    std::mt19937 rng(1);
+    std::string in = random_bytes(rng, 4096);
+    check_round_trip(in);
+    CHECK(ChatCompress::encode_frame(in).empty()); // sent as plain text instead
+
+    // Short messages never get a frame, however repetitive
+    CHECK(ChatCompress::encode_frame(std::string(ChatCompress::MIN_COMPRESS_BYTES - 1, 'a')).empty());
+}
+
+static void test_long_matches() {
+    std::string runs(100000, 'a');
+    std::string block = compress(runs);
+    CHECK(block.size() < runs.size() / 100); // one match with a long run of 255 length bytes
+    check_round_trip(runs);
+
+    std::string lines;
+    while (lines.size() < 60000) lines += "[12:00:00] alice: the quick brown fox jumps over the lazy dog\n";
+    check_round_trip(lines);
+
+    // Long literal run followed by a long match
+    std::mt19937 rng(2);
+    check_round_trip(random_bytes(rng, 1000) + std::string(5000, 'b') + random_bytes(rng, 300));
+}
+
+static void test_overlapping_copies() {
+    // 'a', then a 24-byte match at offset 1 (15 from the token + 5 extra), then 5 closing literals
+    std::string block = {'\x1f', 'a', '\x01', '\x00', '\x05', '\x50', 'b', 'c', 'd', 'e', 'f'};
+    std::string out;
+    CHECK(decompress(block, 30, out));
+    CHECK(out == std::string(25, 'a') + "bcdef");
+
+    // "ab" repeated through a match at offset 2
+    block = {'\x26', 'a', 'b', '\x02', '\x00', '\x50', 'v', 'w', 'x', 'y', 'z'};
+    CHECK(decompress(block, 17, out));
+    CHECK(out == "ababababababvwxyz");
+
+    check_round_trip(std::string(3000, 'x') + "end of run");
+    check_round_trip(std::string(1, 'q') + std::string(40, 'z') + "abcabcabcabcabcabcabcabc!!!!!");
+}
+
+static void test_truncated_frames() {
+    std::string text;
+    while (text.size() < 2000) text += "truncated frame payload line\n";
+    std::string frame = ChatCompress::encode_frame(text);
+    CHECK(!frame.empty());
+
+    for (std::size_t len = 1; len < frame.size(); ++len) {
+        std::size_t consumed = 0;
+        std::string out = "kept";
+        CHECK(ChatCompress::decode_frame(frame.data(), len, consumed, out) == DecodeResult::NeedMore);
+        CHECK(out == "kept");
+    }
+
+    std::size_t consumed = 0;
+    std::string out;
+    std::string stream = frame + "next line\n";
+    CHECK(ChatCompress::decode_frame(stream.data(), stream.size(), consumed, out) == DecodeResult::Ok);
+    CHECK(consumed == frame.size());
+    CHECK(out == text);
+
+    // A block cut short, or decoding to the wrong length, is corrupt rather than partial
+    std::string block = compress(text);
+    CHECK(!decompress(block.substr(0, block.size() - 1), text.size(), out));
+    CHECK(!decompress(block, text.size() - 1, out));
+    CHECK(!decompress(block, text.size() + 1, out));
+}
+
+static void test_bad_offsets() {
+    std::string out;
+
+    // Offset 0
+    std::string block = {'\x10', 'a', '\x00', '\x00', '\x50', 'b', 'c', 'd', 'e', 'f'};
+    CHECK(!decompress(block, 10, out));
+
+    // Offset reaching back before the start of the output
+    block = {'\x10', 'a', '\x02', '\x00', '\x50', 'b', 'c', 'd', 'e', 'f'};
+    CHECK(!decompress(block, 10, out));
+
+    // Match running past the declared output size
+    block = {'\x1f', 'a', '\x01', '\x00', '\xff', '\x50', 'b', 'c', 'd', 'e', 'f'};
+    CHECK(!decompress(block, 30, out));
+
+    // The same bad block inside a frame is reported as corrupt and appends nothing
+    std::string frame = {ChatCompress::FRAME_MARKER, '\x0a', '\x0a', '\x10', 'a', '\x02', '\x00', '\x50', 'b', 'c', 'd', 'e', 'f'};
+    std::size_t consumed = 0;
+    std::string text;
+    CHECK(ChatCompress::decode_frame(frame.data(), frame.size(), consumed, text) == DecodeResult::Corrupt);
+    CHECK(text.empty());
+
+    // Frames that don't start with the marker, or claim more than MAX_FRAME_BYTES
+    CHECK(ChatCompress::decode_frame("x", 1, consumed, text) == DecodeResult::Corrupt);
+    std::string huge = {ChatCompress::FRAME_MARKER, '\x81', '\x80', '\x80', '\x01', '\x01', '\x00'};
+    CHECK(ChatCompress::decode_frame(huge.data(), huge.size(), consumed, text) == DecodeResult::Corrupt);
+}
+
+static void test_random_round_trips() {
+    std::mt19937 rng(3);
+    const std::string alphabet = "abcd \n";
+    for (int i = 0; i < 500; ++i) {
+        std::size_t len = rng() % 5000;
+        std::string in(len, '\0');
+        for (auto& c : in) c = alphabet[rng() % alphabet.size()]; // small alphabet: plenty of short matches
+        check_round_trip(in);
+
+        std::string frame = ChatCompress::encode_frame(in);
+        if (frame.empty()) continue;
+        std::size_t consumed = 0;
+        std::string text;
+        CHECK(ChatCompress::decode_frame(frame.data(), frame.size(), consumed, text) == DecodeResult::Ok);
+        CHECK(consumed == frame.size());
+        CHECK(text == in);
+    }
+}
+
+int main() {
+    test_empty();
+    test_incompressible();
+    test_long_matches();
+    test_overlapping_copies();
+    test_truncated_frames();
+    test_bad_offsets();
+    test_random_round_trips();
+
+    if (failures) {
+        std::fprintf(stderr, "compress_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("compress_test: all checks passed\n");
+    return 0;
+}